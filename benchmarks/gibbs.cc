@@ -0,0 +1,128 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <distributions/random.hpp>
+#include <distributions/gibbs.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/timers.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+typedef NormalInverseChiSq Model;
+typedef GibbsSampler<Model> Sampler;
+
+std::vector<Model::Value> generate_data(size_t row_count, rng_t & rng) {
+    auto shared = Model::Shared::EXAMPLE();
+    shared.kappa = 0.01;
+    const size_t cluster_count = 20;
+    std::vector<Model::Group> clusters(cluster_count);
+    for (auto & cluster : clusters) {
+        cluster.init(shared, rng);
+        cluster.add_value(shared, 10 * sample_unif01(rng) - 5, rng);
+    }
+    std::vector<Model::Value> values;
+    for (size_t i = 0; i < row_count; ++i) {
+        const auto & cluster = clusters[i % cluster_count];
+        values.push_back(cluster.sample_value(shared, rng));
+    }
+    std::shuffle(values.begin(), values.end(), rng);
+    return values;
+}
+
+// thread_count = 0 runs the sequential sweep, and mh_step_count > 0
+// runs Metropolis-Hastings sweeps instead
+void speedtest(
+        const std::vector<Model::Value> & values,
+        size_t thread_count,
+        size_t rows_per_barrier,
+        size_t sweep_count,
+        size_t mh_step_count = 0) {
+    rng_t rng;
+    Sampler::ClusteringModel clustering;
+    clustering.alpha = 1.0;
+    clustering.d = 0.1;
+    auto shared = Model::Shared::EXAMPLE();
+    Sampler sampler(clustering, shared, values, rng);
+    ThreadPool pool(std::max<size_t>(1, thread_count));
+
+    if (mh_step_count) {
+        std::cout << "mh" << '\t' << mh_step_count;
+    } else if (thread_count) {
+        std::cout << thread_count << '\t' << rows_per_barrier;
+    } else {
+        std::cout << "seq" << '\t' << '-';
+    }
+
+    int64_t time = 0;
+    for (size_t i = 0; i < sweep_count; ++i) {
+        time -= current_time_us();
+        if (mh_step_count) {
+            sampler.mh_sweep(mh_step_count, 256, rng);
+        } else if (thread_count) {
+            sampler.parallel_sweep(pool, rows_per_barrier, rng);
+        } else {
+            sampler.sweep(rng);
+        }
+        time += current_time_us();
+        if (i % 4 == 3 or i + 1 == sweep_count) {
+            std::cout << '\t' << std::fixed << std::setprecision(0) <<
+                sampler.score_data(rng);
+        }
+    }
+    double rows_per_us = values.size() * sweep_count * 1.0 / time;
+    std::cout << '\t' << sampler.group_count() <<
+        '\t' << std::setprecision(3) << rows_per_us << '\n';
+}
+
+int main(int argc, char ** argv) {
+    size_t row_count = (argc > 1) ? atoi(argv[1]) : 20000;
+    size_t sweep_count = (argc > 2) ? atoi(argv[2]) : 12;
+    size_t max_threads = std::max<size_t>(
+        1,
+        std::thread::hardware_concurrency());
+
+    rng_t rng;
+    const auto values = generate_data(row_count, rng);
+
+    std::cout << "threads\tbarrier/steps\tscore every 4 sweeps ...\t"
+        "groups\trows/us\n";
+    speedtest(values, 0, 0, sweep_count);
+    for (size_t mh_step_count : {2, 8}) {
+        speedtest(values, 0, 0, sweep_count, mh_step_count);
+    }
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        for (size_t rows_per_barrier : {64, 4096}) {
+            speedtest(values, threads, rows_per_barrier, sweep_count);
+        }
+    }
+
+    return 0;
+}
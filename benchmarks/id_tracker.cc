@@ -0,0 +1,88 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <distributions/random.hpp>
+#include <distributions/mixture.hpp>
+#include <distributions/timers.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+typedef MixtureIdTracker::Id Id;
+
+// Old groups survive while newer groups churn, so that old ids are held
+// below the tracker's dense window.
+void speedtest(size_t survivor_count, size_t iters, rng_t & rng) {
+    MixtureIdTracker tracker;
+    tracker.init(survivor_count);
+    for (size_t i = 0; i < 10 * survivor_count + 1000; ++i) {
+        tracker.add_group();
+        tracker.remove_group(tracker.packed_size() - 1);
+    }
+    std::vector<Id> globals;
+    for (Id global = 0; global < survivor_count; ++global) {
+        globals.push_back(global);
+    }
+    std::shuffle(globals.begin(), globals.end(), rng);
+
+    size_t bogus = 0;
+    int64_t time = -current_time_us();
+    for (size_t i = 0; i < iters; ++i) {
+        for (Id global : globals) {
+            bogus += tracker.global_to_packed(global);
+        }
+    }
+    time += current_time_us();
+    double lookups_per_us = iters * survivor_count * 1.0 / time;
+
+    time = -current_time_us();
+    for (Id global : globals) {
+        tracker.remove_group(tracker.global_to_packed(global));
+    }
+    time += current_time_us();
+    double removes_per_us = survivor_count * 1.0 / std::max<int64_t>(1, time);
+
+    std::cout <<
+        survivor_count << '\t' <<
+        std::setw(10) << std::fixed << std::setprecision(1) <<
+        lookups_per_us << '\t' <<
+        std::setw(10) << std::fixed << std::setprecision(1) <<
+        removes_per_us << '\t' <<
+        (bogus % 2) << '\n';
+}
+
+int main() {
+    rng_t rng;
+    std::cout << "survivors\tlookups/us\tremoves/us\n";
+    for (size_t survivor_count : {10, 100, 1000, 10000, 100000, 1000000}) {
+        size_t iters = std::max<size_t>(1, 10000000 / survivor_count);
+        speedtest(survivor_count, iters, rng);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <distributions/random.hpp>
+#include <distributions/gibbs.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/timers.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+typedef NormalInverseChiSq Model;
+typedef GibbsSampler<Model> Sampler;
+
+std::vector<Model::Value> generate_data(size_t row_count, rng_t & rng) {
+    auto shared = Model::Shared::EXAMPLE();
+    shared.kappa = 0.01;
+    const size_t cluster_count = 20;
+    std::vector<Model::Group> clusters(cluster_count);
+    for (auto & cluster : clusters) {
+        cluster.init(shared, rng);
+        cluster.add_value(shared, 10 * sample_unif01(rng) - 5, rng);
+    }
+    std::vector<Model::Value> values;
+    for (size_t i = 0; i < row_count; ++i) {
+        const auto & cluster = clusters[i % cluster_count];
+        values.push_back(cluster.sample_value(shared, rng));
+    }
+    std::shuffle(values.begin(), values.end(), rng);
+    return values;
+}
+
+// Streams rows into an empty sampler, resampling the newest window rows
+// after every batch_size rows.
+void speedtest(
+        const std::vector<Model::Value> & values,
+        bool map,
+        size_t batch_size,
+        size_t window) {
+    rng_t rng;
+    Sampler::ClusteringModel clustering;
+    clustering.alpha = 1.0;
+    clustering.d = 0.1;
+    auto shared = Model::Shared::EXAMPLE();
+    Sampler sampler(clustering, shared, std::vector<Model::Value>(), rng);
+
+    int64_t time = -current_time_us();
+    for (size_t row = 0; row < values.size(); ++row) {
+        sampler.ingest(values[row], rng, map);
+        if (window and (row + 1) % batch_size == 0) {
+            sampler.resample_recent(window, rng);
+        }
+    }
+    time += current_time_us();
+
+    double rows_per_us = values.size() * 1.0 / time;
+    std::cout << (map ? "map" : "sample") << '\t' << batch_size <<
+        '\t' << window <<
+        '\t' << std::fixed << std::setprecision(0) <<
+        sampler.score_data(rng) <<
+        '\t' << sampler.group_count() <<
+        '\t' << std::setprecision(3) << rows_per_us << '\n';
+}
+
+int main(int argc, char ** argv) {
+    size_t row_count = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    rng_t rng;
+    const auto values = generate_data(row_count, rng);
+
+    std::cout << "assign\tbatch\twindow\tscore\tgroups\trows/us\n";
+    for (bool map : {false, true}) {
+        speedtest(values, map, 1, 0);
+        speedtest(values, map, 256, 256);
+        speedtest(values, map, 256, 1024);
+    }
+
+    return 0;
+}
@@ -35,6 +35,7 @@
 #include <distributions/models/gp.hpp>
 #include <distributions/models/bnb.hpp>
 #include <distributions/models/nich.hpp>
+#include <distributions/models/niw.hpp>
 #include <distributions/timers.hpp>
 
 using namespace distributions;  // NOLINT(*)
@@ -165,6 +166,7 @@ int main() {
     speedtests<GammaPoisson>();
     speedtests<BetaNegativeBinomial>();
     speedtests<NormalInverseChiSq>();
+    speedtests<NormalInverseWishart<3>>();
 
     return 0;
 }
@@ -0,0 +1,160 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <distributions/random.hpp>
+#include <distributions/clustering.hpp>
+#include <distributions/models/bb.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/parallel_sampler.hpp>
+#include <distributions/timers.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+rng_t rng;
+
+template<class Model>
+struct Feature {
+    typename Model::Shared shared;
+    typename Model::Mixture mixture;
+    std::vector<typename Model::Value> values;
+
+    Feature(size_t group_count, size_t row_count) :
+            shared(Model::Shared::EXAMPLE()) {
+        mixture.groups().resize(group_count);
+        for (auto & group : mixture.groups()) {
+            group.init(shared, rng);
+            group.add_value(shared, group.sample_value(shared, rng), rng);
+        }
+        mixture.init(shared, rng);
+        typename Model::Group prior;
+        prior.init(shared, rng);
+        for (size_t i = 0; i < row_count; ++i) {
+            values.push_back(prior.sample_value(shared, rng));
+        }
+    }
+
+    void score(
+            size_t row,
+            size_t begin,
+            AlignedFloats chunk,
+            rng_t & rng) const {
+        mixture.score_value_range(shared, values[row], begin, chunk, rng);
+    }
+};
+
+void speedtest(size_t group_count, size_t thread_count, size_t iters) {
+    typedef Clustering<int>::PitmanYor Model;
+    Model model;
+    model.alpha = 1.0;
+    model.d = 0.1;
+    Model::Mixture clustering;
+    clustering.counts().resize(group_count, 1);
+    clustering.counts().push_back(0);
+    clustering.init(model);
+    ++group_count;
+
+    const size_t row_count = 64;
+    Feature<BetaBernoulli> bb(group_count, row_count);
+    Feature<NormalInverseChiSq> nich1(group_count, row_count);
+    Feature<NormalInverseChiSq> nich2(group_count, row_count);
+
+    ThreadPool pool(thread_count);
+    ParallelGroupSampler sampler(pool);
+    VectorFloat scores;
+
+    int64_t time = -current_time_us();
+    size_t checksum = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        const size_t row = i % row_count;
+        checksum += sampler.sample(rng, group_count, scores,
+            [&](size_t begin, AlignedFloats chunk, rng_t & rng) {
+                clustering.score_value_range(model, begin, chunk);
+                bb.score(row, begin, chunk, rng);
+                nich1.score(row, begin, chunk, rng);
+                nich2.score(row, begin, chunk, rng);
+            });
+    }
+    time += current_time_us();
+
+    double us_per_row = time * 1.0 / iters;
+    std::cout <<
+        group_count << '\t' <<
+        thread_count << '\t' <<
+        sampler.chunk_count() << '\t' <<
+        std::right << std::setw(10) << std::fixed << std::setprecision(2) <<
+        us_per_row << '\t' <<
+        (checksum % 10) << '\n';
+}
+
+// Round trip of an empty batch, i.e. the cost of waking and joining workers.
+void dispatchtest(size_t thread_count, size_t iters) {
+    ThreadPool pool(thread_count);
+    std::atomic<size_t> checksum(0);
+
+    int64_t time = -current_time_us();
+    for (size_t i = 0; i < iters; ++i) {
+        pool.parallel_for(pool.size(), [&](size_t task) {
+            checksum += task;
+        });
+    }
+    time += current_time_us();
+
+    double us_per_batch = time * 1.0 / iters;
+    std::cout <<
+        thread_count << '\t' <<
+        std::right << std::setw(10) << std::fixed << std::setprecision(2) <<
+        us_per_batch << '\t' <<
+        (checksum % 10) << '\n';
+}
+
+int main(int argc, char ** argv) {
+    size_t max_exponent = (argc > 1) ? atoi(argv[1]) : 6;
+    size_t max_threads = (argc > 2) ? atoi(argv[2]) : std::max<size_t>(
+        1,
+        std::thread::hardware_concurrency());
+
+    std::cout << "threads\tus/batch\t(checksum)\n";
+    for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+        dispatchtest(threads, 100000);
+    }
+
+    std::cout << "groups\tthreads\tchunks\tus/row\t(checksum)\n";
+    for (size_t i = 3; i <= max_exponent; ++i) {
+        size_t group_count = size_t(round(pow(10, i)));
+        size_t iters = std::max<size_t>(10, 100000000 / group_count / 10);
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            speedtest(group_count, threads, iters);
+        }
+    }
+
+    return 0;
+}
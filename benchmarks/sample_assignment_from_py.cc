@@ -28,6 +28,7 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdio>
+#include <algorithm>
 #include <distributions/random.hpp>
 #include <distributions/clustering.hpp>
 #include <distributions/timers.hpp>
@@ -46,48 +47,71 @@ inline int max(const std::vector<int> & counts) {
     return result;
 }
 
-size_t speedtest(size_t size, size_t iters, float alpha, float d) {
-    Clustering<int>::PitmanYor model;
-    model.alpha = alpha;
-    model.d = d;
+typedef Clustering<int>::PitmanYor Model;
+typedef std::vector<int> (Model::*Sampler)(int, rng_t &) const;
 
+double speedtest(
+        const Model & model,
+        Sampler sampler,
+        size_t size,
+        size_t iters,
+        double & total_cats) {
     rng_t rng;
 
     int64_t time = -current_time_us();
 
-    size_t bogus = 0;
-    double total_cats = 0;
+    total_cats = 0;
     for (size_t i = 0; i < iters; ++i) {
-        total_cats += max(model.sample_assignments(size, rng));
+        total_cats += max((model.*sampler)(size, rng));
     }
 
     time += current_time_us();
 
     double time_sec = time * 1e-6;
-    double samples_per_sec = iters / time_sec;
+    return iters / time_sec;
+}
+
+void speedtest(size_t size, size_t iters, float alpha, float d) {
+    Model model;
+    model.alpha = alpha;
+    model.d = d;
+
+    // the scan sampler counts in float precision
+    const size_t max_scan_size = 1 << 24;
+
+    double total_cats = 0;
+    double scan_rate = 0;
+    if (size <= max_scan_size) {
+        scan_rate = speedtest(
+            model, &Model::sample_assignments_scan, size, iters, total_cats);
+    }
+    double tree_rate = speedtest(
+        model, &Model::sample_assignments_tree, size, iters, total_cats);
     double mean_cats = total_cats / iters;
+
     std::cout <<
         size << '\t' <<
-        std::right << std::setw(6) << std::fixed << std::setprecision(1) <<
+        std::right << std::setw(8) << std::fixed << std::setprecision(1) <<
         mean_cats << '\t' <<
         std::right << std::setw(12) << std::fixed << std::setprecision(1) <<
-        samples_per_sec << '\n';
-
-    return bogus;
+        scan_rate << '\t' <<
+        std::right << std::setw(12) << std::fixed << std::setprecision(1) <<
+        tree_rate << '\n';
 }
 
 int main(int argc, char ** argv) {
     float alpha = (argc > 1) ? atof(argv[1]) : 1.0f;
     float d = (argc > 2) ? atof(argv[2]) : 0.2f;
+    size_t max_exponent = (argc > 3) ? atoi(argv[3]) : 8;
 
-    std::cout << "size" << '\t' << "cats" << '\t' << "samples/sec";
+    std::cout << "size" << '\t' << "cats" << '\t';
+    std::cout << "scan samples/sec" << '\t' << "tree samples/sec";
     std::cout << " (alpha = " << alpha << ", d = " << d << ")\n";
 
     size_t min_exponent = 3;
-    size_t max_exponent = 6;
     for (size_t i = min_exponent; i <= max_exponent; ++i) {
         size_t size = size_t(round(pow(10, i)));
-        size_t iters = 10000000 / size;
+        size_t iters = std::max<size_t>(1, 10000000 / size);
         speedtest(size, iters, alpha, d);
     }
 
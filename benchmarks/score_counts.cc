@@ -46,8 +46,11 @@ inline int max(const std::vector<int> & counts) {
     return result;
 }
 
+typedef Clustering<int>::PitmanYor Model;
+typedef Clustering<int>::CountHistogram CountHistogram;
+
 size_t speedtest(size_t size, size_t iters, float alpha, float d) {
-    Clustering<int>::PitmanYor model;
+    Model model;
     model.alpha = alpha;
     model.d = d;
 
@@ -57,24 +60,57 @@ size_t speedtest(size_t size, size_t iters, float alpha, float d) {
     for (auto groupid : assignments) {
         ++counts[groupid];
     }
+    const CountHistogram histogram = Clustering<int>::count_counts(counts);
 
-    int64_t time = -current_time_us();
+    // a 10 x 10 grid with d in the outer loop
+    const size_t grid_size = 10;
+    std::vector<Model> grid;
+    for (size_t i = 0; i < grid_size; ++i) {
+        for (size_t j = 0; j < grid_size; ++j) {
+            Model point;
+            point.d = 0.1f * i;
+            point.alpha = 0.5f * (j + 1);
+            grid.push_back(point);
+        }
+    }
+    std::vector<float> grid_scores;
 
     double bogus = 0;
+
+    int64_t time = -current_time_us();
     for (size_t i = 0; i < iters; ++i) {
         bogus += model.score_counts(counts);
     }
+    time += current_time_us();
+    double counts_per_sec = iters / (time * 1e-6);
 
+    time = -current_time_us();
+    for (size_t i = 0; i < iters; ++i) {
+        bogus += model.score_counts(histogram);
+    }
     time += current_time_us();
+    double histogram_per_sec = iters / (time * 1e-6);
+
+    time = -current_time_us();
+    for (size_t i = 0; i < iters; ++i) {
+        Model::score_counts_grid(histogram, grid, grid_scores);
+        bogus += grid_scores[0];
+    }
+    time += current_time_us();
+    double grid_per_sec = iters * grid.size() / (time * 1e-6);
 
-    double time_sec = time * 1e-6;
-    double scores_per_sec = iters / time_sec;
     std::cout <<
         size << '\t' <<
         std::right << std::setw(6) << std::fixed << std::setprecision(1) <<
-        max(counts) << '\t' <<
+        counts.size() << '\t' <<
+        std::right << std::setw(6) << std::fixed << std::setprecision(1) <<
+        histogram.bins.size() << '\t' <<
+        std::right << std::setw(12) << std::fixed << std::setprecision(1) <<
+        counts_per_sec << '\t' <<
+        std::right << std::setw(12) << std::fixed << std::setprecision(1) <<
+        histogram_per_sec << '\t' <<
         std::right << std::setw(12) << std::fixed << std::setprecision(1) <<
-        scores_per_sec << '\n';
+        grid_per_sec << '\n';
 
     return bogus;
 }
@@ -83,7 +119,9 @@ int main(int argc, char ** argv) {
     float alpha = (argc > 1) ? atof(argv[1]) : 1.0f;
     float d = (argc > 2) ? atof(argv[2]) : 0.2f;
 
-    std::cout << "size" << '\t' << "max cat" << '\t' << "scores/sec";
+    std::cout << "size" << '\t' << "groups" << '\t' << "sizes" << '\t';
+    std::cout << "counts/sec" << '\t' << "histograms/sec" << '\t';
+    std::cout << "grid points/sec";
     std::cout << " (alpha = " << alpha << ", d = " << d << ")\n";
 
     size_t min_exponent = 3;
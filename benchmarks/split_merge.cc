@@ -0,0 +1,105 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <distributions/random.hpp>
+#include <distributions/gibbs.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/timers.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+typedef NormalInverseChiSq Model;
+typedef GibbsSampler<Model> Sampler;
+
+Model::Shared make_shared() {
+    auto shared = Model::Shared::EXAMPLE();
+    shared.kappa = 0.01;
+    return shared;
+}
+
+// Clusters have unit variance and means 10 apart.
+std::vector<Model::Value> generate_data(
+        size_t row_count,
+        size_t cluster_count,
+        rng_t & rng) {
+    std::vector<Model::Value> values;
+    for (size_t i = 0; i < row_count; ++i) {
+        float mean = 10.f * (i % cluster_count) - 5.f * cluster_count;
+        values.push_back(mean + sample_std_normal(rng));
+    }
+    std::shuffle(values.begin(), values.end(), rng);
+    return values;
+}
+
+// Starts from a single group, as after a bad initialization, and prints
+// the score after each sweep.  attempt_count = 0 runs plain Gibbs.
+void speedtest(
+        const std::vector<Model::Value> & values,
+        size_t attempt_count,
+        size_t sweep_count) {
+    rng_t rng;
+    Sampler::ClusteringModel clustering;
+    clustering.alpha = 1.0;
+    clustering.d = 0.1;
+    auto shared = make_shared();
+    Sampler sampler(clustering, shared, values, rng);
+    sampler.merge_all(rng);
+
+    std::cout << attempt_count;
+    int64_t time = 0;
+    for (size_t i = 0; i < sweep_count; ++i) {
+        time -= current_time_us();
+        sampler.sweep(rng);
+        sampler.split_merge(attempt_count, 1, rng);
+        time += current_time_us();
+        std::cout << '\t' << std::fixed << std::setprecision(0) <<
+            sampler.score_data(rng);
+    }
+    double sweeps_per_sec = sweep_count * 1e6 / time;
+    std::cout << '\t' << sampler.group_count() <<
+        '\t' << std::setprecision(3) << sweeps_per_sec << '\n';
+}
+
+int main(int argc, char ** argv) {
+    size_t row_count = (argc > 1) ? atoi(argv[1]) : 2000;
+    size_t cluster_count = (argc > 2) ? atoi(argv[2]) : 8;
+    size_t sweep_count = (argc > 3) ? atoi(argv[3]) : 10;
+
+    rng_t rng;
+    const auto values = generate_data(row_count, cluster_count, rng);
+
+    std::cout << "split-merge attempts per sweep\tscore after each sweep "
+        "...\tgroups\tsweeps/sec\n";
+    for (size_t attempt_count : {0, 10, 100}) {
+        speedtest(values, attempt_count, sweep_count);
+    }
+
+    return 0;
+}
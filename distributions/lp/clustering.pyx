@@ -25,6 +25,7 @@
 # TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
 # USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+from libc.stdint cimport int64_t
 from libcpp.vector cimport vector
 from libcpp.utility cimport pair
 cimport numpy
@@ -34,12 +35,12 @@ from cython.operator cimport dereference as deref, preincrement as inc
 from distributions.rng_cc cimport rng_t
 from distributions.global_rng cimport get_rng
 from distributions.lp.vector cimport VectorFloat, vector_float_to_ndarray
+from distributions.lp.thread_pool cimport ThreadPool, ThreadPool_cc
 from distributions.mixins import SharedIoMixin
 
 
 cdef extern from 'distributions/mixture.hpp':
-    cppclass IdSet \
-            "std::unordered_set<size_t, distributions::TrivialHash<size_t>>":
+    cppclass IdSet "distributions::DenseIdSet":
         cppclass iterator "const_iterator":
             size_t & operator*()
             iterator operator++() nogil
@@ -49,84 +50,137 @@ cdef extern from 'distributions/mixture.hpp':
 
 
 cdef extern from 'distributions/clustering.hpp':
-    cppclass Assignments "distributions::Clustering<int>::Assignments":
+    cppclass Assignments "distributions::Clustering<int64_t>::Assignments":
         Assignments() nogil except +
         cppclass iterator:
-            pair[int, int] & operator*() nogil
+            pair[int64_t, int64_t] & operator*() nogil
             iterator operator++() nogil
             bint operator!=(iterator) nogil
-        int & operator[](int) nogil
+        int64_t & operator[](int64_t) nogil
         iterator begin() nogil
         iterator end() nogil
 
-    cdef vector[int] count_assignments_cc \
-            "distributions::Clustering<int>::count_assignments" \
+    cdef vector[int64_t] count_assignments_cc \
+            "distributions::Clustering<int64_t>::count_assignments" \
             (Assignments & assignments) nogil except +
 
-    cppclass PitmanYor_cc "distributions::Clustering<int>::PitmanYor":
+    cdef void count_dense_assignments_cc \
+            "distributions::Clustering<int64_t>::count_assignments" \
+            (int64_t * assignments, size_t size, vector[int64_t] & counts) \
+            nogil except +
+
+    cdef void count_dense_assignments_pool_cc \
+            "distributions::Clustering<int64_t>::count_assignments" \
+            (int64_t * assignments, size_t size, vector[int64_t] & counts,
+             ThreadPool_cc & pool) nogil except +
+
+    cppclass PitmanYor_cc "distributions::Clustering<int64_t>::PitmanYor":
         float alpha
         float d
-        vector[int] sample_assignments(int size, rng_t & rng) nogil except +
+        vector[int64_t] sample_assignments(
+                int64_t size,
+                rng_t & rng) nogil except +
         cppclass Mixture:
             size_t size "counts().size" () nogil except +
             IdSet.iterator empty_groupids_begin \
                     "empty_groupids().begin" () nogil except +
             IdSet.iterator empty_groupids_end \
                     "empty_groupids().end" () nogil except +
-            void set_counts "counts() = " (vector[int] &) nogil except +
+            void set_counts "counts() = " (vector[int64_t] &) nogil except +
+            vector[int64_t] & counts() nogil except +
             void init (PitmanYor_cc &) nogil except +
             bint add_value (PitmanYor_cc &, size_t) nogil except +
             bint remove_value (PitmanYor_cc &, size_t) nogil except +
             void score_value (PitmanYor_cc &, VectorFloat &) nogil except +
-        float score_counts(vector[int] & counts) nogil except +
+        float score_counts(vector[int64_t] & counts) nogil except +
         float score_add_value (
-                int group_size,
-                int nonempty_group_count,
-                int sample_size,
-                int empty_group_count) nogil except +
+                int64_t group_size,
+                int64_t nonempty_group_count,
+                int64_t sample_size,
+                int64_t empty_group_count) nogil except +
         float score_remove_value (
-                int group_size,
-                int nonempty_group_count,
-                int sample_size,
-                int empty_group_count) nogil except +
-
-    cppclass LowEntropy_cc "distributions::Clustering<int>::LowEntropy":
-        int dataset_size
-        vector[int] sample_assignments(int size, rng_t & rng) nogil except +
+                int64_t group_size,
+                int64_t nonempty_group_count,
+                int64_t sample_size,
+                int64_t empty_group_count) nogil except +
+
+    cppclass LowEntropy_cc "distributions::Clustering<int64_t>::LowEntropy":
+        int64_t dataset_size
+        vector[int64_t] sample_assignments(
+                int64_t size,
+                rng_t & rng) nogil except +
         cppclass Mixture:
             size_t size "counts().size" () nogil except +
             IdSet.iterator empty_groupids_begin \
                     "empty_groupids().begin" () nogil except +
             IdSet.iterator empty_groupids_end \
                     "empty_groupids().end" () nogil except +
-            void set_counts "counts() = " (vector[int] &) nogil except +
+            void set_counts "counts() = " (vector[int64_t] &) nogil except +
+            vector[int64_t] & counts() nogil except +
             void init (LowEntropy_cc &) nogil except +
             bint add_value (LowEntropy_cc &, size_t) nogil except +
             bint remove_value (LowEntropy_cc &, size_t) nogil except +
             void score_value (LowEntropy_cc &, VectorFloat &) nogil except +
-        float score_counts(vector[int] & counts) nogil except +
+        float score_counts(vector[int64_t] & counts) nogil except +
         float score_add_value (
-                int group_size,
-                int nonempty_group_count,
-                int sample_size,
-                int empty_group_count) nogil except +
+                int64_t group_size,
+                int64_t nonempty_group_count,
+                int64_t sample_size,
+                int64_t empty_group_count) nogil except +
         float score_remove_value (
-                int group_size,
-                int nonempty_group_count,
-                int sample_size,
-                int empty_group_count) nogil except +
-
-
-cpdef list count_assignments(dict assignments):
+                int64_t group_size,
+                int64_t nonempty_group_count,
+                int64_t sample_size,
+                int64_t empty_group_count) nogil except +
+
+
+def count_assignments(assignments, ThreadPool pool=None):
+    """
+    Count group sizes, given either a dict {value_id: group_id}
+    or a dense array whose i-th entry is the group_id of value i.
+    Dense arrays are counted without the GIL, in parallel if given a pool.
+    """
+    if isinstance(assignments, dict):
+        return count_sparse_assignments(assignments)
+    else:
+        return count_dense_assignments(
+            numpy.asarray(assignments, 'int64'),
+            pool)
+
+
+cpdef list count_sparse_assignments(dict assignments):
     cdef Assignments assignments_cc
-    cdef int value_id
-    cdef int group_id
+    cdef int64_t value_id
+    cdef int64_t group_id
     for value_id, group_id in assignments.iteritems():
         assignments_cc[value_id] = group_id
     cdef list counts = count_assignments_cc(assignments_cc)
     return counts
 
 
+cdef void _count_dense_assignments(
+        numpy.ndarray assignments,
+        vector[int64_t] & counts,
+        ThreadPool pool) except *:
+    assignments = numpy.ascontiguousarray(assignments, dtype=numpy.int64)
+    cdef int64_t * data = <int64_t *> assignments.data
+    cdef size_t size = assignments.shape[0]
+    if pool is None:
+        with nogil:
+            count_dense_assignments_cc(data, size, counts)
+    else:
+        with nogil:
+            count_dense_assignments_pool_cc(data, size, counts, pool.ptr[0])
+
+
+cpdef list count_dense_assignments(
+        numpy.ndarray[numpy.int64_t, ndim=1] assignments,
+        ThreadPool pool=None):
+    cdef vector[int64_t] counts
+    _count_dense_assignments(assignments, counts, pool)
+    return counts
+
+
 cdef dict dump_assignments(Assignments & assignments):
     cdef dict raw = {}
     cdef Assignments.iterator i = assignments.begin()
@@ -175,21 +229,21 @@ cdef class PitmanYor_cy:
             'd': self.ptr.d,
         }
 
-    def sample_assignments(self, int size):
+    def sample_assignments(self, int64_t size):
         cdef list assignments = self.ptr.sample_assignments(size, get_rng()[0])
         return assignments
 
     def score_counts(self, list counts):
-        cdef vector[int] counts_cc = counts
+        cdef vector[int64_t] counts_cc = counts
         cdef float score = self.ptr.score_counts(counts_cc)
         return score
 
     def score_add_value(
             self,
-            int group_size,
-            int nonempty_group_count,
-            int sample_size,
-            int empty_group_count=1):
+            int64_t group_size,
+            int64_t nonempty_group_count,
+            int64_t sample_size,
+            int64_t empty_group_count=1):
         return self.ptr.score_add_value(
             group_size,
             nonempty_group_count,
@@ -198,10 +252,10 @@ cdef class PitmanYor_cy:
 
     def score_remove_value(
             self,
-            int group_size,
-            int nonempty_group_count,
-            int sample_size,
-            int empty_group_count=1):
+            int64_t group_size,
+            int64_t nonempty_group_count,
+            int64_t sample_size,
+            int64_t empty_group_count=1):
         return self.ptr.score_remove_value(
             group_size,
             nonempty_group_count,
@@ -237,10 +291,19 @@ cdef class PitmanYorMixture:
                 inc(i)
 
     def init(self, PitmanYor_cy model, list counts):
-        cdef vector[int] counts_cc = counts
+        cdef vector[int64_t] counts_cc = counts
         self.ptr.set_counts(counts_cc)
         self.ptr.init(model.ptr[0])
 
+    def init_assignments(
+            self,
+            PitmanYor_cy model,
+            numpy.ndarray[numpy.int64_t, ndim=1] assignments,
+            ThreadPool pool=None):
+        _count_dense_assignments(assignments, self.ptr.counts(), pool)
+        self.ptr.counts().push_back(0)
+        self.ptr.init(model.ptr[0])
+
     def add_value(self, PitmanYor_cy model, int groupid):
         return self.ptr.add_value(model.ptr[0], groupid)
 
@@ -292,28 +355,28 @@ cdef class LowEntropy_cy:
             return self.ptr.dataset_size
 
     def load(self, dict raw):
-        cdef int dataset_size = raw['dataset_size']
+        cdef int64_t dataset_size = raw['dataset_size']
         assert dataset_size >= 0
         self.ptr.dataset_size = dataset_size
 
     def dump(self):
         return {'dataset_size': self.ptr.dataset_size}
 
-    def sample_assignments(self, int size):
+    def sample_assignments(self, int64_t size):
         cdef list assignments = self.ptr.sample_assignments(size, get_rng()[0])
         return assignments
 
     def score_counts(self, list counts):
-        cdef vector[int] counts_cc = counts
+        cdef vector[int64_t] counts_cc = counts
         cdef float score = self.ptr.score_counts(counts_cc)
         return score
 
     def score_add_value(
             self,
-            int group_size,
-            int nonempty_group_count,
-            int sample_size,
-            int empty_group_count=1):
+            int64_t group_size,
+            int64_t nonempty_group_count,
+            int64_t sample_size,
+            int64_t empty_group_count=1):
         return self.ptr.score_add_value(
             group_size,
             nonempty_group_count,
@@ -322,10 +385,10 @@ cdef class LowEntropy_cy:
 
     def score_remove_value(
             self,
-            int group_size,
-            int nonempty_group_count,
-            int sample_size,
-            int empty_group_count=1):
+            int64_t group_size,
+            int64_t nonempty_group_count,
+            int64_t sample_size,
+            int64_t empty_group_count=1):
         return self.ptr.score_remove_value(
             group_size,
             nonempty_group_count,
@@ -360,10 +423,19 @@ cdef class LowEntropyMixture:
                 inc(i)
 
     def init(self, LowEntropy_cy model, list counts):
-        cdef vector[int] counts_cc = counts
+        cdef vector[int64_t] counts_cc = counts
         self.ptr.set_counts(counts_cc)
         self.ptr.init(model.ptr[0])
 
+    def init_assignments(
+            self,
+            LowEntropy_cy model,
+            numpy.ndarray[numpy.int64_t, ndim=1] assignments,
+            ThreadPool pool=None):
+        _count_dense_assignments(assignments, self.ptr.counts(), pool)
+        self.ptr.counts().push_back(0)
+        self.ptr.init(model.ptr[0])
+
     def add_value(self, LowEntropy_cy model, int groupid):
         return self.ptr.add_value(model.ptr[0], groupid)
 
@@ -388,6 +460,6 @@ class LowEntropy(LowEntropy_cy, SharedIoMixin):
     def protobuf_dump(self, message):
         dumped = self.dump()
         message.Clear()
-        message.datset_size = dumped['dataset_size']
+        message.dataset_size = dumped['dataset_size']
 
     Mixture = LowEntropyMixture
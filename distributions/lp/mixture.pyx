@@ -26,6 +26,9 @@
 # USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 from libc.stdint cimport uint32_t
+cimport numpy
+numpy.import_array()
+import numpy
 
 
 cdef extern from "distributions/mixture.hpp":
@@ -35,6 +38,14 @@ cdef extern from "distributions/mixture.hpp":
         void remove_group (uint32_t packed) nogil except +
         uint32_t packed_to_global (uint32_t packed) nogil except +
         uint32_t global_to_packed (uint32_t packed) nogil except +
+        void packed_to_global_batch "packed_to_global" (
+                size_t size,
+                uint32_t * packed,
+                uint32_t * global_) nogil except +
+        void global_to_packed_batch "global_to_packed" (
+                size_t size,
+                uint32_t * global_,
+                uint32_t * packed) nogil except +
 
 
 cdef class MixtureIdTracker:
@@ -58,3 +69,31 @@ cdef class MixtureIdTracker:
 
     def global_to_packed(self, int global_):
         return self.ptr.global_to_packed(global_)
+
+    def packed_to_global_array(self, packed):
+        cdef numpy.ndarray[numpy.uint32_t, ndim=1] packed_cc = \
+            numpy.ascontiguousarray(packed, dtype=numpy.uint32)
+        cdef size_t size = packed_cc.shape[0]
+        cdef numpy.ndarray[numpy.uint32_t, ndim=1] global_cc = \
+            numpy.empty(size, dtype=numpy.uint32)
+        if size:
+            with nogil:
+                self.ptr.packed_to_global_batch(
+                    size,
+                    &packed_cc[0],
+                    &global_cc[0])
+        return global_cc
+
+    def global_to_packed_array(self, global_):
+        cdef numpy.ndarray[numpy.uint32_t, ndim=1] global_cc = \
+            numpy.ascontiguousarray(global_, dtype=numpy.uint32)
+        cdef size_t size = global_cc.shape[0]
+        cdef numpy.ndarray[numpy.uint32_t, ndim=1] packed_cc = \
+            numpy.empty(size, dtype=numpy.uint32)
+        if size:
+            with nogil:
+                self.ptr.global_to_packed_batch(
+                    size,
+                    &global_cc[0],
+                    &packed_cc[0])
+        return packed_cc
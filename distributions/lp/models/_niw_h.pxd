@@ -44,6 +44,7 @@ cdef extern from "distributions/models/niw.hpp" namespace "distributions::Normal
         VectorXf sum_x
         MatrixXf sum_xxT
 
+        void touch () nogil
         void init (Shared &, rng_t &) nogil except +
         void add_value (Shared &, Value &, rng_t &) nogil except +
         void add_repeated_value (Shared &, Value &, int &, rng_t &) nogil except +
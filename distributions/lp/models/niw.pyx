@@ -166,6 +166,7 @@ cdef class _Group(_niw.Group):
         self.ptr.sum_x = to_eigen_vecf(raw['sum_x'])
         assert raw['sum_xxT'] is not None
         self.ptr.sum_xxT = to_eigen_matf(raw['sum_xxT'])
+        self.ptr.touch()
 
     def dump(self):
         return {
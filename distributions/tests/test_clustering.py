@@ -27,6 +27,7 @@
 
 import math
 import functools
+import threading
 from collections import defaultdict
 import numpy
 import numpy.random
@@ -52,6 +53,7 @@ import distributions.dbg.clustering
 require_cython()
 import distributions.lp.clustering
 from distributions.lp.clustering import count_assignments
+from distributions.lp.thread_pool import ThreadPool
 from distributions.lp.mixture import MixtureIdTracker
 
 MODELS = {
@@ -318,3 +320,70 @@ def test_mixture_score_matches_score_add_value(model_name):
                             counts[groupid] = back
                     check_counts(mixture, counts, empty_group_count)
                     check_scores(model, mixture, counts, empty_group_count)
+
+
+def test_count_dense_assignments():
+    assignments = numpy.arange(1000) % 7
+    numpy.random.shuffle(assignments)
+    expected = count_assignments(dict(enumerate(assignments)))
+    actual = count_assignments(assignments)
+    assert_equal(actual, expected)
+
+
+def test_count_dense_assignments_pool():
+    # Large enough to split into chunks across the pool.
+    assignments = numpy.arange(1 << 20) % 7
+    numpy.random.shuffle(assignments)
+    expected = count_assignments(assignments)
+    pool = ThreadPool(3)
+    assert_equal(len(pool), 3)
+    actual = count_assignments(assignments, pool)
+    assert_equal(actual, expected)
+
+    results = [None] * 4
+
+    def count(i):
+        results[i] = count_assignments(assignments, pool)
+
+    threads = [threading.Thread(target=count, args=(i,)) for i in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    for actual in results:
+        assert_equal(actual, expected)
+
+
+@pytest.mark.parametrize('model_name', ['lp.PitmanYor', 'lp.LowEntropy'])
+def test_mixture_init_assignments(model_name):
+    Model = MODELS[model_name]
+    model = Model()
+    model.load(Model.EXAMPLES[-1])
+    assignments = numpy.arange(100, dtype=numpy.int64) % 7
+    counts = count_assignments(assignments) + [0]
+
+    expected = Model.Mixture()
+    expected.init(model, counts)
+    actual = Model.Mixture()
+    actual.init_assignments(model, assignments)
+    assert_equal(len(actual), len(counts))
+
+    expected_scores = numpy.zeros(len(counts), dtype=numpy.float32)
+    actual_scores = numpy.zeros(len(counts), dtype=numpy.float32)
+    expected.score_value(model, expected_scores)
+    actual.score_value(model, actual_scores)
+    assert_close(actual_scores, expected_scores)
+
+
+def test_id_tracker_arrays():
+    id_tracker = MixtureIdTracker()
+    id_tracker.init(10)
+    for packed in [0, 3, 0, 5]:
+        id_tracker.remove_group(packed)
+        id_tracker.add_group()
+    packed = numpy.arange(10, dtype=numpy.uint32)
+    global_ = id_tracker.packed_to_global_array(packed)
+    expected = [id_tracker.packed_to_global(p) for p in packed]
+    assert_equal(list(global_), expected)
+    actual = id_tracker.global_to_packed_array(global_)
+    assert_equal(list(actual), list(packed))
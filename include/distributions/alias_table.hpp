@@ -0,0 +1,80 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <distributions/common.hpp>
+#include <distributions/random.hpp>
+#include <distributions/vector.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Alias Table
+//
+// This samples from a fixed discrete distribution in O(1) time after an
+// O(size) build, using Vose's alias method.  Tables are typically left
+// stale while the distribution drifts, and corrected by a
+// Metropolis-Hastings step that needs score(i), the normalized log
+// probability of proposing i.
+
+class AliasTable {
+ public:
+    // Builds a table sampling i with probability proportional to
+    // exp(scores[i]).
+    void init(const float * scores, size_t size);
+
+    size_t size() const { return probs_.size(); }
+
+    size_t sample(rng_t & rng) const {
+        const size_t size = probs_.size();
+        const float u = sample_unif01(rng) * size;
+        size_t i = static_cast<size_t>(u);
+        if (DIST_UNLIKELY(i >= size)) {
+            i = size - 1;
+        }
+        return (u - i < probs_[i]) ? i : aliases_[i];
+    }
+
+    float score(size_t i) const {
+        if (DIST_DEBUG_LEVEL >= 2) {
+            DIST_ASSERT_LT(i, scores_.size());
+        }
+        return scores_[i];
+    }
+
+ private:
+    VectorFloat probs_;
+    std::vector<uint32_t> aliases_;
+    VectorFloat scores_;
+    std::vector<uint32_t> small_;
+    std::vector<uint32_t> large_;
+};
+
+}   // namespace distributions
@@ -33,13 +33,16 @@
 #include <distributions/common.hpp>
 #include <distributions/random.hpp>
 #include <distributions/vector.hpp>
+#include <distributions/fenwick.hpp>
 #include <distributions/trivial_hash.hpp>
 #include <distributions/mixture.hpp>
+#include <distributions/thread_pool.hpp>
 
 namespace distributions {
 
 // This is explicitly instantiated for:
-// - int32_t
+// - int32_t, uint32_t
+// - int64_t, uint64_t, for datasets of more than 2^31 rows
 // To add datatypes, edit the bottom of src/clustering.cc
 template<class count_t>
 struct Clustering {
@@ -51,6 +54,32 @@ typedef std::unordered_map<count_t, count_t, TrivialHash<count_t>> Assignments;
 static std::vector<count_t> count_assignments(
         const Assignments & assignments);
 
+// This counts a dense array where row i is assigned to assignments[i].
+// Counts are written directly into counts, e.g. mixture.counts(), which
+// must then be given an empty group and init(model)ed before use.
+static void count_assignments(
+        const count_t * assignments,
+        size_t size,
+        std::vector<count_t> & counts);
+
+// As above, but histograms large arrays in parallel on pool.
+static void count_assignments(
+        const count_t * assignments,
+        size_t size,
+        std::vector<count_t> & counts,
+        ThreadPool & pool);
+
+// A count-of-counts summarizes group sizes by the number of groups of each
+// distinct nonempty size, so that exchangeable scores can be computed once
+// per distinct size rather than once per group.
+struct CountHistogram {
+    std::vector<std::pair<count_t, count_t>> bins;  // (size, group count)
+    count_t sample_size;
+    count_t group_count;
+};
+
+static CountHistogram count_counts(const std::vector<count_t> & counts);
+
 
 // --------------------------------------------------------------------------
 // Pitman-Yor Model
@@ -71,13 +100,37 @@ struct PitmanYor {
         message.set_d(d);
     }
 
+    // This dispatches to one of the following samplers, which are exposed
+    // for benchmarking.  The scan sampler is faster when few tables are
+    // expected; the tree sampler scales to many tables and huge sizes.
     std::vector<count_t> sample_assignments(
             count_t size,
             rng_t & rng) const;
 
+    std::vector<count_t> sample_assignments_scan(
+            count_t size,
+            rng_t & rng) const;
+
+    std::vector<count_t> sample_assignments_tree(
+            count_t size,
+            rng_t & rng) const;
+
+    float expected_group_count(count_t sample_size) const;
+
     float score_counts(
             const std::vector<count_t> & counts) const;
 
+    float score_counts(
+            const CountHistogram & histogram) const;
+
+    // This scores one histogram under many hyperparameters.  Grid points
+    // sharing d with their predecessor reuse the per-size terms, so grids
+    // should be ordered with d in the outer loop.
+    static void score_counts_grid(
+            const CountHistogram & histogram,
+            const std::vector<PitmanYor> & grid,
+            std::vector<float> & scores);
+
     float score_add_value(
             count_t group_size,
             count_t nonempty_group_count,
@@ -196,10 +249,21 @@ struct PitmanYor {
             if (DIST_DEBUG_LEVEL >= 1) {
                 DIST_ASSERT_EQ(scores.size(), counts().size());
             }
+            score_value_range(model, 0, scores);
+        }
+
+        // Writes scores of groups [begin, begin + scores.size()).
+        void score_value_range(
+                const Model & model,
+                size_t begin,
+                AlignedFloats scores) const {
+            if (DIST_DEBUG_LEVEL >= 1) {
+                DIST_ASSERT_LE(begin + scores.size(), counts().size());
+            }
 
-            const size_t size = counts().size();
+            const size_t size = scores.size();
             const float shift = -fast_log(sample_size() + model.alpha);
-            const float * __restrict__ in = VectorFloat_data(shifted_scores_);
+            const float * __restrict__ in = shifted_scores_.data() + begin;
             float * __restrict__ out = VectorFloat_data(scores);
 
             for (size_t i = 0; i < size; ++i) {
@@ -207,6 +271,16 @@ struct PitmanYor {
             }
         }
 
+        float score_value_group(
+                const Model & model,
+                size_t groupid) const {
+            if (DIST_DEBUG_LEVEL >= 1) {
+                DIST_ASSERT_LT(groupid, counts().size());
+            }
+            const float shift = -fast_log(sample_size() + model.alpha);
+            return shifted_scores_[groupid] + shift;
+        }
+
         float score_data(const Model & model) const {
             return driver_.score_data(model);
         }
@@ -310,7 +384,130 @@ struct LowEntropy {
 
     float log_partition_function(count_t sample_size) const;
 
-    typedef MixtureDriver<LowEntropy, count_t> Mixture;
+    // HACK gcc doesn't want Mixture defined outside of LowEntropy
+    class CachedMixture {
+     public:
+        typedef LowEntropy Model;
+        typedef typename MixtureDriver<LowEntropy, count_t>::IdSet IdSet;
+
+        std::vector<count_t> & counts() {
+            return driver_.counts();
+        }
+
+        const std::vector<count_t> & counts() const {
+            return driver_.counts();
+        }
+
+        count_t counts(size_t groupid) const {
+            return driver_.counts(groupid);
+        }
+
+        const IdSet & empty_groupids() const {
+            return driver_.empty_groupids();
+        }
+
+        size_t sample_size() const {
+            return driver_.sample_size();
+        }
+
+        void init(const Model & model) {
+            driver_.init(model);
+            const size_t group_count = driver_.counts().size();
+            scores_.resize(group_count);
+            for (size_t i = 0; i < group_count; ++i) {
+                if (driver_.counts(i)) {
+                    _update_nonempty_group(model, i);
+                }
+            }
+        }
+
+        bool add_value(
+                const Model & model,
+                size_t groupid,
+                count_t count = 1) {
+            const bool add_group = driver_.add_value(model, groupid, count);
+
+            if (DIST_UNLIKELY(add_group)) {
+                scores_.packed_add();
+            }
+            _update_nonempty_group(model, groupid);
+
+            return add_group;
+        }
+
+        bool remove_value(
+                const Model & model,
+                size_t groupid,
+                count_t count = 1) {
+            const bool remove_group =
+                driver_.remove_value(model, groupid, count);
+
+            if (DIST_UNLIKELY(remove_group)) {
+                scores_.packed_remove(groupid);
+            } else {
+                _update_nonempty_group(model, groupid);
+            }
+
+            return remove_group;
+        }
+
+        void score_value(const Model & model, AlignedFloats scores) const {
+            if (DIST_DEBUG_LEVEL >= 1) {
+                DIST_ASSERT_EQ(scores.size(), counts().size());
+            }
+            score_value_range(model, 0, scores);
+        }
+
+        // Writes scores of groups [begin, begin + scores.size()).
+        void score_value_range(
+                const Model & model,
+                size_t begin,
+                AlignedFloats scores) const {
+            if (DIST_DEBUG_LEVEL >= 1) {
+                DIST_ASSERT_LE(begin + scores.size(), counts().size());
+            }
+
+            const size_t size = scores.size();
+            const float * __restrict__ in = scores_.data() + begin;
+            float * __restrict__ out = VectorFloat_data(scores);
+
+            for (size_t i = 0; i < size; ++i) {
+                out[i] = in[i];
+            }
+
+            // empty group scores depend on sample_size, so are not cached
+            const count_t bogus = 0;
+            const float empty_score = model.score_add_value(
+                0,
+                bogus,
+                sample_size(),
+                empty_groupids().size());
+            for (size_t i : empty_groupids()) {
+                if (i - begin < size) {
+                    out[i - begin] = empty_score;
+                }
+            }
+        }
+
+        float score_data(const Model & model) const {
+            return driver_.score_data(model);
+        }
+
+     private:
+        void _update_nonempty_group(const Model & model, size_t groupid) {
+            auto const group_size = counts(groupid);
+            DIST_ASSERT2(group_size, "expected nonempty group");
+            const count_t bogus = 0;
+            scores_[groupid] = model.score_add_value(group_size, bogus, bogus);
+        }
+
+        MixtureDriver<LowEntropy, count_t> driver_;
+        VectorFloat scores_;
+    };
+
+    // The uncached version is useful for debugging
+    // typedef MixtureDriver<LowEntropy, count_t> Mixture;
+    typedef CachedMixture Mixture;
 
  private:
     // ad hoc approximation,
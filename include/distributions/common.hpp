@@ -37,7 +37,6 @@
 #endif  // __GNUG__
 
 #ifdef __GNUG__
-#  define thread_local __thread
 #  define DIST_LIKELY(x) __builtin_expect(!!(x), true)
 #  define DIST_UNLIKELY(x) __builtin_expect(!!(x), false)
 #else  // __GNUG__
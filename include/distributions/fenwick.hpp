@@ -0,0 +1,123 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <vector>
+#include <distributions/common.hpp>
+#include <distributions/random.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Fenwick Tree
+//
+// This maintains cumulative sums of a growable vector of likelihoods,
+// supporting O(log size) updates and O(log size) sampling.
+// Sums are kept in double precision so that large counts can be
+// incremented by one without loss.
+
+class FenwickTree {
+ public:
+    FenwickTree() : total_(0) {}
+
+    size_t size() const { return values_.size(); }
+    double total() const { return total_; }
+    double operator[] (size_t pos) const { return values_[pos]; }
+
+    void clear() {
+        values_.clear();
+        tree_.clear();
+        total_ = 0;
+    }
+
+    void reserve(size_t size) {
+        values_.reserve(size);
+        tree_.reserve(size);
+    }
+
+    void push_back(double value) {
+        // node i covers the half-open range (i - lowbit(i), i], 1-based
+        const size_t node = tree_.size() + 1;
+        const size_t lowbit = node & (~node + 1);
+        double sum = value;
+        for (size_t step = 1; step < lowbit; step <<= 1) {
+            sum += tree_[node - step - 1];
+        }
+        values_.push_back(value);
+        tree_.push_back(sum);
+        total_ += value;
+    }
+
+    void add(size_t pos, double delta) {
+        DIST_ASSERT1(pos < size(), "bad pos: " << pos);
+        values_[pos] += delta;
+        total_ += delta;
+        const size_t size = tree_.size();
+        for (size_t node = pos + 1; node <= size; node += node & (~node + 1)) {
+            tree_[node - 1] += delta;
+        }
+    }
+
+    void set(size_t pos, double value) {
+        add(pos, value - values_[pos]);
+    }
+
+    // returns the first pos whose cumulative sum exceeds t
+    size_t find(double t) const {
+        const size_t size = tree_.size();
+        DIST_ASSERT1(size, "cannot search empty tree");
+        size_t step = 1;
+        while (step * 2 <= size) {
+            step *= 2;
+        }
+        size_t pos = 0;
+        for (; step; step >>= 1) {
+            const size_t next = pos + step;
+            if (next <= size and tree_[next - 1] <= t) {
+                pos = next;
+                t -= tree_[next - 1];
+            }
+        }
+        return pos < size ? pos : size - 1;
+    }
+
+ private:
+    std::vector<double> values_;
+    std::vector<double> tree_;
+    double total_;
+};
+
+inline size_t sample_from_likelihoods(
+        rng_t & rng,
+        const FenwickTree & likelihoods) {
+    std::uniform_real_distribution<double> sampler(0.0, 1.0);
+    return likelihoods.find(likelihoods.total() * sampler(rng));
+}
+
+}  // namespace distributions
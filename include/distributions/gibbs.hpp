@@ -0,0 +1,1058 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <type_traits>
+#include <distributions/common.hpp>
+#include <distributions/random.hpp>
+#include <distributions/vector.hpp>
+#include <distributions/vector_math.hpp>
+#include <distributions/alias_table.hpp>
+#include <distributions/clustering.hpp>
+#include <distributions/mixture.hpp>
+#include <distributions/thread_pool.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Value Alias Tables
+//
+// This keeps one stale alias table of feature scores per value, for
+// GibbsSampler::mh_sweep feature proposals.  Tables are kept only for
+// integral values; for other values, e.g. vectors with no std::hash,
+// find() returns no table and no map is instantiated.
+
+template<class Value, bool = std::is_integral<Value>::value>
+class ValueAliasTables {
+ public:
+    static constexpr bool enabled() { return true; }
+
+    // Returns the table of value, first rebuilding it from score(),
+    // which returns the value's group scores, if it was last built
+    // before epoch.  Epochs start from 1.
+    template<class Score>
+    const AliasTable * find(const Value & value, size_t epoch, Score score) {
+        Entry & entry = tables_[value];
+        if (entry.epoch != epoch) {
+            const VectorFloat & scores = score();
+            entry.table.init(scores.data(), scores.size());
+            entry.epoch = epoch;
+        }
+        return & entry.table;
+    }
+
+ private:
+    // Entries are value-initialized with epoch 0, so they are built
+    // before first use.
+    struct Entry {
+        AliasTable table;
+        size_t epoch;
+    };
+
+    std::unordered_map<Value, Entry> tables_;
+};
+
+template<class Value>
+class ValueAliasTables<Value, false> {
+ public:
+    static constexpr bool enabled() { return false; }
+
+    template<class Score>
+    const AliasTable * find(const Value &, size_t, Score) { return nullptr; }
+};
+
+// --------------------------------------------------------------------------
+// Gibbs Sampler
+//
+// This runs collapsed Gibbs sweeps over the rows of a Pitman-Yor mixture
+// of one Model, which may be a ProductModel of several features, in which
+// case every move below updates and scores every feature's groups.
+// sweep() is the usual sequential sampler.
+//
+// ingest() appends streamed rows without a full sweep, assigning each by
+// one scoring pass; resample_recent() then revisits a bounded window of
+// the newest rows, whose early assignments saw the least data.
+//
+// parallel_sweep() is AD-LDA style (Newman et al. 2009): rows are split
+// into one contiguous range per thread, and between barriers each thread
+// samples its rows against the global state as of the last barrier, read
+// only, patched by its own moves but not those of other threads.  A thread
+// patches only the groups it touches, copying each on first touch, and
+// opens new groups privately.  Each thread also keeps its share of every
+// group, i.e. a group of just its own rows, built once per sweep.  At each
+// barrier, each touched group is rebuilt by Group::merge of the threads'
+// shares, and each privately opened group becomes a fresh global group, so
+// two threads opening new groups open distinct groups.
+//
+// split_merge() runs Jain-Neal split-merge proposals (Jain & Neal 2004),
+// which pull apart or join whole groups in one move.  Each proposal picks
+// two anchor rows; the other rows of their groups are allocated between
+// two scratch groups sequentially and then by restricted Gibbs scans, and
+// merged likelihoods come from Group::merge.  Rows are gathered by one
+// pass over all rows.
+//
+// mh_sweep() is LightLDA style: each row takes a few Metropolis-Hastings
+// steps whose proposals cost O(1), corrected by exact scores from
+// score_value_group, so that per-row cost does not grow with the number
+// of groups.  Proposals alternate between the clustering prior and, for
+// integral values, feature scores.  Clustering proposals take the group
+// of a uniformly random other row, or open a new group, which proposes
+// exactly in proportion to current group sizes.  Feature proposals come
+// from stale per-value alias tables, rebuilt once per block of
+// rebuild_period rows.  Unlike LightLDA, tables score only anchored
+// groups, i.e. groups of rows outside the block, plus one entry for empty
+// groups.  Rows outside the block do not move until the next rebuild, so
+// each table depends only on rows other than the moving row, and the
+// Metropolis-Hastings correction is exact.  Groups of only block rows are
+// never proposed by tables.
+
+template<class Model_, class count_t = int>
+class GibbsSampler {
+ public:
+    typedef Model_ Model;
+    typedef typename Model::Shared Shared;
+    typedef typename Model::Value Value;
+    typedef typename Model::Group Group;
+    typedef typename Model::Mixture Mixture;
+    typedef typename Clustering<count_t>::PitmanYor ClusteringModel;
+    typedef typename ClusteringModel::Mixture ClusteringMixture;
+    typedef MixtureIdTracker::Id Id;
+
+    // Rows are initially assigned by sequential sampling in row order,
+    // as if ingested one at a time.
+    GibbsSampler(
+            const ClusteringModel & clustering_model,
+            const Shared & shared,
+            const std::vector<Value> & values,
+            rng_t & rng,
+            size_t empty_group_count = 1) :
+        clustering_model_(clustering_model),
+        shared_(shared),
+        values_(),
+        assignments_(),
+        table_epoch_(0) {
+        DIST_ASSERT(empty_group_count, "empty_group_count must be positive");
+        state_.clustering.counts().assign(empty_group_count, 0);
+        state_.clustering.init(clustering_model_);
+        state_.mixture.init(shared_, rng);
+        for (size_t i = 0; i < empty_group_count; ++i) {
+            state_.mixture.add_group(shared_, rng);
+        }
+        state_.mixture.set_lazy(true);
+        state_.tracker.init(empty_group_count);
+
+        values_.reserve(values.size());
+        assignments_.reserve(values.size());
+        for (const Value & value : values) {
+            ingest(value, rng);
+        }
+    }
+
+    const ClusteringMixture & clustering() const { return state_.clustering; }
+    const Mixture & mixture() const { return state_.mixture; }
+    const MixtureIdTracker & tracker() const { return state_.tracker; }
+
+    const std::vector<Value> & values() const { return values_; }
+
+    // Assignments are global ids of tracker().
+    const std::vector<Id> & assignments() const { return assignments_; }
+
+    size_t group_count() const {
+        return state_.clustering.counts().size()
+             - state_.clustering.empty_groupids().size();
+    }
+
+    float score_data(rng_t & rng) const {
+        return state_.clustering.score_data(clustering_model_)
+             + state_.mixture.score_data(shared_, rng);
+    }
+
+    // Appends one row, assigned by a single scoring pass over groups,
+    // either sampled or, if map is set, to the most likely group.
+    // Returns the new row's index.
+    size_t ingest(const Value & value, rng_t & rng, bool map = false) {
+        const size_t row = values_.size();
+        values_.push_back(value);
+        const Value & row_value = values_[row];
+        size_t groupid;
+        if (map) {
+            _score_groups(state_, row_value, rng, scores_);
+            groupid = std::max_element(scores_.begin(), scores_.end())
+                    - scores_.begin();
+        } else {
+            groupid = _sample_group(state_, row_value, rng);
+        }
+        assignments_.push_back(state_.tracker.packed_to_global(groupid));
+        _add_value(state_, groupid, row_value, rng);
+        return row;
+    }
+
+    // Resamples the most recent window rows, e.g. after ingesting a batch.
+    void resample_recent(size_t window, rng_t & rng) {
+        const size_t end = values_.size();
+        for (size_t row = end - std::min(window, end); row < end; ++row) {
+            assignments_[row] =
+                _resample(state_, assignments_[row], values_[row], rng);
+        }
+    }
+
+    void sweep(rng_t & rng) {
+        for (size_t row = 0; row < values_.size(); ++row) {
+            assignments_[row] =
+                _resample(state_, assignments_[row], values_[row], rng);
+        }
+    }
+
+    // Each thread samples up to rows_per_barrier rows between barriers.
+    void parallel_sweep(
+            ThreadPool & pool,
+            size_t rows_per_barrier,
+            rng_t & rng) {
+        DIST_ASSERT(rows_per_barrier, "rows_per_barrier must be positive");
+        const size_t thread_count = pool.size();
+        const size_t row_count = values_.size();
+        while (workers_.size() < thread_count) {
+            workers_.push_back(Worker());
+            workers_.back().rng.seed(rng());
+        }
+        workers_.resize(thread_count);
+
+        const size_t range = (row_count + thread_count - 1) / thread_count;
+        pool.parallel_for(thread_count, [&](size_t t) {
+            const size_t begin = std::min(row_count, t * range);
+            const size_t end = std::min(row_count, begin + range);
+            _init_shares(workers_[t], begin, end);
+        });
+        for (size_t offset = 0; offset < range; offset += rows_per_barrier) {
+            _snapshot(rng);
+            pool.parallel_for(thread_count, [&](size_t t) {
+                const size_t stop = std::min(row_count, (t + 1) * range);
+                const size_t begin = std::min(stop, t * range + offset);
+                const size_t end = std::min(stop, begin + rows_per_barrier);
+                _sample_block(workers_[t], begin, end);
+            });
+            _merge_blocks(rng);
+        }
+    }
+
+    // Runs attempt_count split-merge proposals, each refining its launch
+    // state with launch_scan_count restricted Gibbs scans.
+    // Returns the number of accepted proposals.
+    size_t split_merge(
+            size_t attempt_count,
+            size_t launch_scan_count,
+            rng_t & rng) {
+        if (values_.size() < 2) {
+            return 0;
+        }
+        size_t accepted_count = 0;
+        for (size_t i = 0; i < attempt_count; ++i) {
+            accepted_count += _split_merge(launch_scan_count, rng);
+        }
+        return accepted_count;
+    }
+
+    // Runs step_count Metropolis-Hastings steps per row, rebuilding
+    // feature proposal tables before each block of rebuild_period rows.
+    // Blocks should be a small fraction of all rows, since tables cannot
+    // propose groups of only block rows.
+    void mh_sweep(
+            size_t step_count,
+            size_t rebuild_period,
+            rng_t & rng) {
+        DIST_ASSERT(rebuild_period, "rebuild_period must be positive");
+        const size_t row_count = values_.size();
+        for (size_t begin = 0; begin < row_count; begin += rebuild_period) {
+            const size_t end = std::min(row_count, begin + rebuild_period);
+            _rebuild_tables(begin, end, rng);
+            for (size_t row = begin; row < end; ++row) {
+                assignments_[row] = _mh_resample(row, step_count, rng);
+            }
+        }
+    }
+
+    // Moves every row into the group of row 0, e.g. to start sampling
+    // from the coarsest partition.
+    void merge_all(rng_t & rng) {
+        if (values_.empty()) {
+            return;
+        }
+        const Id to = assignments_[0];
+        for (size_t row = 1; row < values_.size(); ++row) {
+            _move(row, to, rng);
+        }
+    }
+
+    void validate() const {
+        const size_t group_count = state_.clustering.counts().size();
+        DIST_ASSERT_EQ(state_.mixture.size(), group_count);
+        DIST_ASSERT_EQ(state_.tracker.packed_size(), group_count);
+        DIST_ASSERT_EQ(
+            static_cast<size_t>(state_.clustering.sample_size()),
+            values_.size());
+        state_.mixture.validate(shared_);
+    }
+
+ private:
+    struct State {
+        ClusteringMixture clustering;
+        Mixture mixture;
+        MixtureIdTracker tracker;
+    };
+
+    // A thread's share of one group: the group of the thread's own rows.
+    struct Share {
+        count_t count;
+        Group group;
+    };
+
+    // A group touched by a thread since the last barrier, as the thread
+    // sees it.  Groups are identified by block ids: packed ids as of the
+    // last barrier, followed by groups the thread opened since.
+    struct View {
+        size_t block_id;
+        count_t count;
+        Group group;
+    };
+
+    struct Worker {
+        std::unordered_map<Id, Share> shares;  // by global id
+        std::vector<View> views;
+        std::unordered_map<size_t, size_t> view_positions;  // by block id
+        size_t opened_count;
+        std::vector<std::pair<size_t, size_t>> opened_rows;  // row, block id
+        std::vector<Id> opened;  // opened block id - block size -> global id
+        Group empty;
+        VectorFloat scores;
+        rng_t rng;
+    };
+
+    // Scratch state for split_merge, kept to reuse allocations.
+    // Side 0 holds the first anchor row and side 1 the second.
+    struct SplitMerge {
+        Group groups[2];
+        Group merged;
+        count_t counts[2];
+        std::vector<size_t> rows;
+        std::vector<bool> sides;
+        std::vector<bool> original_sides;
+    };
+
+    static Id none() { return ~Id(0); }
+
+    // Removes rows [begin, end), builds their values' feature proposal
+    // tables against the remaining, anchored groups, and re-adds the rows,
+    // reopening each group of only block rows as a fresh group.
+    void _rebuild_tables(size_t begin, size_t end, rng_t & rng) {
+        if (not ValueAliasTables<Value>::enabled()) {
+            return;
+        }
+        ++table_epoch_;
+        for (size_t row = begin; row < end; ++row) {
+            const size_t groupid =
+                state_.tracker.global_to_packed(assignments_[row]);
+            _remove_value(state_, groupid, values_[row], rng);
+        }
+
+        anchored_ids_.clear();
+        anchored_positions_.clear();
+        const auto & counts = state_.clustering.counts();
+        for (size_t groupid = 0; groupid < counts.size(); ++groupid) {
+            if (counts[groupid]) {
+                const Id id = state_.tracker.packed_to_global(groupid);
+                anchored_positions_[id] = anchored_ids_.size();
+                anchored_ids_.push_back(id);
+            }
+        }
+        for (size_t row = begin; row < end; ++row) {
+            _value_table(values_[row], rng);
+        }
+
+        reopened_ids_.clear();
+        for (size_t row = begin; row < end; ++row) {
+            Id & id = assignments_[row];
+            if (not state_.tracker.contains_global(id)) {
+                auto inserted = reopened_ids_.insert(std::make_pair(id, id));
+                if (inserted.second) {
+                    inserted.first->second = state_.tracker.packed_to_global(
+                        * state_.clustering.empty_groupids().begin());
+                }
+                id = inserted.first->second;
+            }
+            _add_value(
+                state_,
+                state_.tracker.global_to_packed(id),
+                values_[row],
+                rng);
+        }
+    }
+
+    // Returns the feature proposal table of value, or null if values
+    // have no tables.  Table positions are those of anchored_ids_,
+    // followed by one position for empty groups.
+    const AliasTable * _value_table(const Value & value, rng_t & rng) {
+        auto score = [&]() -> const VectorFloat & {
+            const size_t group_count = state_.clustering.counts().size();
+            scores_.resize(group_count);
+            vector_zero(group_count, scores_.data());
+            state_.mixture.score_value(shared_, value, scores_, rng);
+            table_scores_.clear();
+            for (const Id & id : anchored_ids_) {
+                const size_t groupid = state_.tracker.global_to_packed(id);
+                table_scores_.push_back(scores_[groupid]);
+            }
+            const size_t empty_groupid =
+                * state_.clustering.empty_groupids().begin();
+            table_scores_.push_back(scores_[empty_groupid]);
+            return table_scores_;
+        };
+        return value_tables_.find(value, table_epoch_, score);
+    }
+
+    // Returns the table position of a group, or for a nonempty group that
+    // is not anchored, which tables cannot propose, any later position.
+    size_t _table_position(size_t groupid) const {
+        const size_t empty_position = anchored_ids_.size();
+        if (not state_.clustering.counts(groupid)) {
+            return empty_position;
+        }
+        const Id id = state_.tracker.packed_to_global(groupid);
+        const auto i = anchored_positions_.find(id);
+        return i == anchored_positions_.end() ? empty_position + 1 : i->second;
+    }
+
+    // Returns the log probability of a table proposing the group at a
+    // table position, up to a constant.
+    float _score_table_proposal(
+            const AliasTable & table,
+            size_t position) const {
+        if (position < anchored_ids_.size()) {
+            return table.score(position);
+        } else {
+            const auto & empty_groupids = state_.clustering.empty_groupids();
+            const float empty_count = empty_groupids.size();
+            return table.score(position) - fast_log(empty_count);
+        }
+    }
+
+    size_t _sample_empty_group(rng_t & rng) const {
+        const auto & empty_groupids = state_.clustering.empty_groupids();
+        const int empty_count = empty_groupids.size();
+        return * (empty_groupids.begin() +
+            sample_int(rng, 0, empty_count - 1));
+    }
+
+    // Proposes the group of a random row other than row, or with
+    // probability proportional to the new group score, an empty group.
+    size_t _propose_group(size_t row, rng_t & rng) const {
+        const auto & clustering = state_.clustering;
+        const int sample_size = clustering.sample_size();
+        const float new_weight = _score_new_weight();
+        const float u = sample_unif01(rng) * (sample_size + new_weight);
+        if (u < sample_size) {
+            size_t other = sample_int(rng, 0, sample_size - 1);
+            other += (other >= row);
+            return state_.tracker.global_to_packed(assignments_[other]);
+        } else {
+            return _sample_empty_group(rng);
+        }
+    }
+
+    // Returns the log probability of _propose_group, up to a constant.
+    float _score_proposal(size_t groupid) const {
+        const auto & clustering = state_.clustering;
+        if (const count_t count = clustering.counts(groupid)) {
+            return fast_log(count);
+        } else {
+            const float empty_count = clustering.empty_groupids().size();
+            return fast_log(_score_new_weight() / empty_count);
+        }
+    }
+
+    float _score_new_weight() const {
+        const size_t nonempty_group_count = group_count();
+        return clustering_model_.alpha
+             + clustering_model_.d * nonempty_group_count;
+    }
+
+    float _score_group(
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const {
+        return state_.clustering.score_value_group(clustering_model_, groupid)
+             + state_.mixture.score_value_group(shared_, groupid, value, rng);
+    }
+
+    // Returns the row's new id in state_.tracker.  Feature proposals from
+    // a group that tables cannot propose back are rejected.
+    Id _mh_resample(size_t row, size_t step_count, rng_t & rng) {
+        const Value & value = values_[row];
+        const Id id = assignments_[row];
+        _remove_value(state_, state_.tracker.global_to_packed(id), value, rng);
+        size_t current;
+        if (DIST_LIKELY(state_.tracker.contains_global(id))) {
+            current = state_.tracker.global_to_packed(id);
+        } else {
+            // a row leaving a singleton is equally in any empty group
+            current = _sample_empty_group(rng);
+        }
+        float current_score = _score_group(current, value, rng);
+
+        for (size_t step = 0; step < step_count; ++step) {
+            size_t proposed;
+            float log_q_ratio;
+            const AliasTable * table =
+                (step % 2) ? _value_table(value, rng) : nullptr;
+            if (table) {
+                const size_t current_position = _table_position(current);
+                if (current_position >= table->size()) {
+                    continue;
+                }
+                const size_t position = table->sample(rng);
+                if (position < anchored_ids_.size()) {
+                    const Id id = anchored_ids_[position];
+                    proposed = state_.tracker.global_to_packed(id);
+                } else {
+                    proposed = _sample_empty_group(rng);
+                }
+                log_q_ratio = _score_table_proposal(*table, current_position)
+                            - _score_table_proposal(*table, position);
+            } else {
+                proposed = _propose_group(row, rng);
+                log_q_ratio = _score_proposal(current)
+                            - _score_proposal(proposed);
+            }
+            if (proposed == current) {
+                continue;
+            }
+            const float proposed_score = _score_group(proposed, value, rng);
+            const float log_accept =
+                proposed_score - current_score + log_q_ratio;
+            if (log_accept >= 0 or
+                    sample_bernoulli(rng, expf(log_accept))) {
+                current = proposed;
+                current_score = proposed_score;
+            }
+        }
+
+        const Id result = state_.tracker.packed_to_global(current);
+        _add_value(state_, current, value, rng);
+        return result;
+    }
+
+    bool _split_merge(size_t launch_scan_count, rng_t & rng) {
+        const int row_count = values_.size();
+        const size_t anchors[2] = {
+            static_cast<size_t>(sample_int(rng, 0, row_count - 1)),
+            static_cast<size_t>(sample_int(rng, 0, row_count - 2))};
+        const size_t row0 = anchors[0];
+        const size_t row1 = anchors[1] + (anchors[1] >= row0);
+        const Id ids[2] = {assignments_[row0], assignments_[row1]};
+        const bool split = (ids[0] == ids[1]);
+
+        SplitMerge & sm = split_merge_;
+        sm.rows.clear();
+        sm.sides.clear();
+        sm.original_sides.clear();
+        for (size_t i = 0; i < 2; ++i) {
+            sm.groups[i].init(shared_, rng);
+            sm.counts[i] = 1;
+        }
+        sm.groups[0].add_value(shared_, values_[row0], rng);
+        sm.groups[1].add_value(shared_, values_[row1], rng);
+        for (size_t row = 0, size = values_.size(); row < size; ++row) {
+            const Id id = assignments_[row];
+            if ((id == ids[0] or id == ids[1]) and row != row0 and
+                    row != row1) {
+                sm.rows.push_back(row);
+            }
+        }
+
+        // The launch state is built by sequential allocation in random
+        // order, then refined by restricted scans.  It depends only on the
+        // anchors, as required for the reverse move.
+        std::shuffle(sm.rows.begin(), sm.rows.end(), rng);
+        for (size_t i = 0, size = sm.rows.size(); i < size; ++i) {
+            sm.original_sides.push_back(assignments_[sm.rows[i]] == ids[1]);
+            sm.sides.push_back(false);
+            _allocate(i, false, rng);
+        }
+        for (size_t i = 0; i < launch_scan_count; ++i) {
+            _restricted_scan(false, rng);
+        }
+
+        // log_ratio is log(p(split) / p(merged)) for the proposed split
+        // or the existing split, and log_q is the log probability of
+        // reaching that split from the launch state.
+        float log_ratio;
+        float log_q;
+        const size_t nonempty_group_count = group_count();
+        if (split) {
+            log_q = _restricted_scan(false, rng);
+            const size_t groupid = state_.tracker.global_to_packed(ids[0]);
+            log_ratio = sm.groups[0].score_data(shared_, rng)
+                      + sm.groups[1].score_data(shared_, rng)
+                      - state_.mixture.score_data_group(shared_, groupid, rng)
+                      + _score_split(
+                            sm.counts[0],
+                            sm.counts[1],
+                            nonempty_group_count);
+        } else {
+            log_q = _restricted_scan(true, rng);
+            const auto & mixture = state_.mixture;
+            const size_t groupid0 = state_.tracker.global_to_packed(ids[0]);
+            const size_t groupid1 = state_.tracker.global_to_packed(ids[1]);
+            sm.merged.init(shared_, rng);
+            mixture.merge_into(shared_, groupid0, sm.merged, rng);
+            mixture.merge_into(shared_, groupid1, sm.merged, rng);
+            log_ratio = mixture.score_data_group(shared_, groupid0, rng)
+                      + mixture.score_data_group(shared_, groupid1, rng)
+                      - sm.merged.score_data(shared_, rng)
+                      + _score_split(
+                            sm.counts[0],
+                            sm.counts[1],
+                            nonempty_group_count - 1);
+        }
+        const float log_accept = split ? log_ratio - log_q : log_q - log_ratio;
+        if (log_accept < 0 and not sample_bernoulli(rng, expf(log_accept))) {
+            return false;
+        }
+
+        if (split) {
+            const auto & empty_groupids = state_.clustering.empty_groupids();
+            const Id to = state_.tracker.packed_to_global(
+                * empty_groupids.begin());
+            _move(row1, to, rng);
+            for (size_t i = 0, size = sm.rows.size(); i < size; ++i) {
+                if (sm.sides[i]) {
+                    _move(sm.rows[i], to, rng);
+                }
+            }
+        } else {
+            for (size_t i = 0, size = sm.rows.size(); i < size; ++i) {
+                if (sm.original_sides[i]) {
+                    _move(sm.rows[i], ids[0], rng);
+                }
+            }
+            _move(row1, ids[0], rng);
+        }
+        return true;
+    }
+
+    // Reassigns each non-anchor row between the two scratch groups,
+    // sampling unless restore is set, in which case rows return to their
+    // original sides.  Returns the log probability of the resulting sides.
+    float _restricted_scan(bool restore, rng_t & rng) {
+        SplitMerge & sm = split_merge_;
+        float log_q = 0;
+        for (size_t i = 0, size = sm.rows.size(); i < size; ++i) {
+            const bool side = sm.sides[i];
+            sm.groups[side].remove_value(shared_, values_[sm.rows[i]], rng);
+            --sm.counts[side];
+            log_q += _allocate(i, restore, rng);
+        }
+        return log_q;
+    }
+
+    // Adds the i-th non-anchor row to one of the scratch groups, as in
+    // _restricted_scan, and returns the log probability of that side.
+    float _allocate(size_t i, bool restore, rng_t & rng) {
+        SplitMerge & sm = split_merge_;
+        const Value & value = values_[sm.rows[i]];
+        const float d = clustering_model_.d;
+        float scores[2];
+        for (size_t j = 0; j < 2; ++j) {
+            scores[j] = fast_log(sm.counts[j] - d)
+                      + sm.groups[j].score_value(shared_, value, rng);
+        }
+        const float log_norm = log_sum_exp(scores[0], scores[1]);
+        bool side;
+        if (restore) {
+            side = sm.original_sides[i];
+        } else {
+            side = sample_bernoulli(rng, expf(scores[1] - log_norm));
+        }
+        sm.sides[i] = side;
+        sm.groups[side].add_value(shared_, value, rng);
+        ++sm.counts[side];
+        return scores[side] - log_norm;
+    }
+
+    // Returns the log Pitman-Yor prior ratio of splitting one group into
+    // groups of size0 and size1 when there are otherwise
+    // nonempty_group_count - 1 nonempty groups.
+    float _score_split(
+            count_t size0,
+            count_t size1,
+            size_t nonempty_group_count) const {
+        const float alpha = clustering_model_.alpha;
+        const float d = clustering_model_.d;
+        return fast_log(alpha + d * nonempty_group_count)
+             + fast_lgamma(size0 - d)
+             + fast_lgamma(size1 - d)
+             - fast_lgamma(1 - d)
+             - fast_lgamma(size0 + size1 - d);
+    }
+
+    // Moves one row to the group with global id to.
+    void _move(size_t row, Id to, rng_t & rng) {
+        const Id from = assignments_[row];
+        if (from != to) {
+            const Value & value = values_[row];
+            _remove_value(
+                state_,
+                state_.tracker.global_to_packed(from),
+                value,
+                rng);
+            _add_value(
+                state_,
+                state_.tracker.global_to_packed(to),
+                value,
+                rng);
+            assignments_[row] = to;
+        }
+    }
+
+    void _init_shares(Worker & worker, size_t begin, size_t end) const {
+        worker.shares.clear();
+        worker.empty.init(shared_, worker.rng);
+        for (size_t row = begin; row < end; ++row) {
+            _add_share(worker, assignments_[row], values_[row]);
+        }
+    }
+
+    void _add_share(Worker & worker, Id id, const Value & value) const {
+        auto inserted = worker.shares.insert(std::make_pair(id, Share()));
+        Share & share = inserted.first->second;
+        if (inserted.second) {
+            share.count = 0;
+            share.group.init(shared_, worker.rng);
+        }
+        ++share.count;
+        share.group.add_value(shared_, value, worker.rng);
+    }
+
+    void _remove_share(Worker & worker, Id id, const Value & value) const {
+        auto i = worker.shares.find(id);
+        DIST_ASSERT1(i != worker.shares.end(), "missing share of " << id);
+        if (--i->second.count) {
+            i->second.group.remove_value(shared_, value, worker.rng);
+        } else {
+            worker.shares.erase(i);
+        }
+    }
+
+    void _snapshot(rng_t & rng) {
+        state_.mixture.flush(shared_, rng);
+        const size_t group_count = state_.clustering.counts().size();
+        block_to_global_.resize(group_count);
+        for (size_t groupid = 0; groupid < group_count; ++groupid) {
+            block_to_global_[groupid] =
+                state_.tracker.packed_to_global(groupid);
+        }
+    }
+
+    // Returns the position in worker.views of a block id, copying a group
+    // of the last barrier on first touch.  Block ids past the last barrier's
+    // groups open a new, empty group.
+    size_t _view(Worker & worker, size_t block_id) const {
+        auto inserted = worker.view_positions.insert(
+            std::make_pair(block_id, worker.views.size()));
+        if (inserted.second) {
+            worker.views.push_back(View());
+            View & view = worker.views.back();
+            view.block_id = block_id;
+            if (block_id < block_to_global_.size()) {
+                view.count = state_.clustering.counts(block_id);
+                state_.mixture.copy_group(block_id, view.group);
+            } else {
+                view.count = 0;
+                view.group = worker.empty;
+                ++worker.opened_count;
+            }
+        }
+        return inserted.first->second;
+    }
+
+    void _sample_block(Worker & worker, size_t begin, size_t end) {
+        worker.views.clear();
+        worker.view_positions.clear();
+        worker.opened_count = 0;
+        worker.opened_rows.clear();
+        const size_t block_size = block_to_global_.size();
+        for (size_t row = begin; row < end; ++row) {
+            const Value & value = values_[row];
+            const Id from = assignments_[row];
+            const size_t source_block_id =
+                state_.tracker.global_to_packed(from);
+            View & source = worker.views[_view(worker, source_block_id)];
+            --source.count;
+            source.group.remove_value(shared_, value, worker.rng);
+            _remove_share(worker, from, value);
+
+            const size_t block_id = _sample_view(worker, value);
+            View & target = worker.views[_view(worker, block_id)];
+            ++target.count;
+            target.group.add_value(shared_, value, worker.rng);
+            if (block_id < block_size) {
+                const Id to = block_to_global_[block_id];
+                _add_share(worker, to, value);
+                assignments_[row] = to;
+            } else {
+                worker.opened_rows.push_back(std::make_pair(row, block_id));
+            }
+        }
+    }
+
+    // Samples a block id, where the last block id opens a new group.
+    // The global state is only read, so workers may score concurrently.
+    size_t _sample_view(Worker & worker, const Value & value) const {
+        const auto & clustering = state_.clustering;
+        const size_t block_size = block_to_global_.size();
+        const size_t new_block_id = block_size + worker.opened_count;
+        VectorFloat & scores = worker.scores;
+        scores.resize(new_block_id + 1);
+        AlignedFloats block_scores(scores.data(), block_size);
+        clustering.score_value(clustering_model_, block_scores);
+        state_.mixture.score_value(shared_, value, block_scores, worker.rng);
+
+        // All new-group mass goes to one private group, so empty groups of
+        // the last barrier and groups this worker emptied are excluded.
+        const count_t nonempty_count =
+            block_size - clustering.empty_groupids().size();
+        const count_t sample_size = clustering.sample_size();
+        const float new_score =
+            clustering_model_.score_add_value(0, nonempty_count, sample_size)
+            + worker.empty.score_value(shared_, value, worker.rng);
+        scores[new_block_id] = new_score;
+        for (size_t block_id : clustering.empty_groupids()) {
+            scores[block_id] = new_score;
+        }
+        for (const View & view : worker.views) {
+            if (view.count) {
+                scores[view.block_id] =
+                    clustering_model_.score_add_value(
+                        view.count,
+                        nonempty_count,
+                        sample_size)
+                    + view.group.score_value(shared_, value, worker.rng);
+            } else {
+                scores[view.block_id] = new_score;
+            }
+        }
+
+        float total = scores_to_likelihoods(scores);
+        for (size_t block_id : clustering.empty_groupids()) {
+            total -= scores[block_id];
+            scores[block_id] = 0;
+        }
+        for (const View & view : worker.views) {
+            if (not view.count) {
+                total -= scores[view.block_id];
+                scores[view.block_id] = 0;
+            }
+        }
+        return sample_from_likelihoods(worker.rng, scores, total);
+    }
+
+    // Rebuilds each touched group from the workers' shares, then opens
+    // the workers' new groups, then removes emptied groups.
+    void _merge_blocks(rng_t & rng) {
+        const size_t block_size = block_to_global_.size();
+        touched_groupids_.clear();
+        for (const Worker & worker : workers_) {
+            for (const View & view : worker.views) {
+                if (view.block_id < block_size) {
+                    touched_groupids_.insert(view.block_id);
+                }
+            }
+        }
+
+        emptied_ids_.clear();
+        for (size_t groupid : touched_groupids_) {
+            const Id id = block_to_global_[groupid];
+            merged_.init(shared_, rng);
+            count_t count = 0;
+            for (const Worker & worker : workers_) {
+                auto i = worker.shares.find(id);
+                if (i != worker.shares.end()) {
+                    merged_.merge(shared_, i->second.group, rng);
+                    count += i->second.count;
+                }
+            }
+            const count_t old_count = state_.clustering.counts(groupid);
+            if (count == 0) {
+                emptied_ids_.push_back(id);
+                continue;
+            } else if (count > old_count) {
+                state_.clustering.add_value(
+                    clustering_model_,
+                    groupid,
+                    count - old_count);
+            } else if (count < old_count) {
+                state_.clustering.remove_value(
+                    clustering_model_,
+                    groupid,
+                    old_count - count);
+            }
+            state_.mixture.update_group(shared_, groupid, merged_, rng);
+        }
+
+        for (Worker & worker : workers_) {
+            worker.opened.assign(worker.opened_count, none());
+            for (View & view : worker.views) {
+                if (view.block_id >= block_size and view.count) {
+                    worker.opened[view.block_id - block_size] =
+                        _open_group(worker, view, rng);
+                }
+            }
+            for (const auto & pair : worker.opened_rows) {
+                assignments_[pair.first] =
+                    worker.opened[pair.second - block_size];
+            }
+        }
+
+        for (Id id : emptied_ids_) {
+            const size_t groupid = state_.tracker.global_to_packed(id);
+            const bool group_removed = state_.clustering.remove_value(
+                clustering_model_,
+                groupid,
+                state_.clustering.counts(groupid));
+            DIST_ASSERT1(group_removed, "expected an emptied group");
+            state_.mixture.remove_group(shared_, groupid);
+            state_.tracker.remove_group(groupid);
+        }
+    }
+
+    // Moves a worker's new group into an empty global group, which
+    // becomes the worker's share, and returns its global id.
+    Id _open_group(Worker & worker, View & view, rng_t & rng) {
+        const size_t groupid = * state_.clustering.empty_groupids().begin();
+        const Id id = state_.tracker.packed_to_global(groupid);
+        Share & share = worker.shares[id];
+        share.count = view.count;
+        share.group = view.group;
+        state_.mixture.update_group(shared_, groupid, view.group, rng);
+        const bool group_added = state_.clustering.add_value(
+            clustering_model_,
+            groupid,
+            view.count);
+        DIST_ASSERT1(group_added, "expected an empty group");
+        state_.mixture.add_group(shared_, rng);
+        state_.tracker.add_group();
+        return id;
+    }
+
+    // Moves one value and returns its new id in state.tracker.
+    Id _resample(
+            State & state,
+            Id id,
+            const Value & value,
+            rng_t & rng) {
+        _remove_value(state, state.tracker.global_to_packed(id), value, rng);
+        const size_t groupid = _sample_group(state, value, rng);
+        const Id result = state.tracker.packed_to_global(groupid);
+        _add_value(state, groupid, value, rng);
+        return result;
+    }
+
+    size_t _sample_group(State & state, const Value & value, rng_t & rng) {
+        return _sample_group(state, value, rng, scores_);
+    }
+
+    size_t _sample_group(
+            const State & state,
+            const Value & value,
+            rng_t & rng,
+            VectorFloat & scores) const {
+        _score_groups(state, value, rng, scores);
+        return sample_from_scores_overwrite(rng, scores);
+    }
+
+    void _score_groups(
+            const State & state,
+            const Value & value,
+            rng_t & rng,
+            VectorFloat & scores) const {
+        scores.resize(state.clustering.counts().size());
+        state.clustering.score_value(clustering_model_, scores);
+        state.mixture.score_value(shared_, value, scores, rng);
+    }
+
+    void _add_value(
+            State & state,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const {
+        const bool group_added =
+            state.clustering.add_value(clustering_model_, groupid);
+        state.mixture.add_value(shared_, groupid, value, rng);
+        if (DIST_UNLIKELY(group_added)) {
+            state.mixture.add_group(shared_, rng);
+            state.tracker.add_group();
+        }
+    }
+
+    void _remove_value(
+            State & state,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const {
+        const bool group_removed =
+            state.clustering.remove_value(clustering_model_, groupid);
+        state.mixture.remove_value(shared_, groupid, value, rng);
+        if (DIST_UNLIKELY(group_removed)) {
+            state.mixture.remove_group(shared_, groupid);
+            state.tracker.remove_group(groupid);
+        }
+    }
+
+    const ClusteringModel clustering_model_;
+    const Shared shared_;
+    std::vector<Value> values_;
+    std::vector<Id> assignments_;
+    State state_;
+    VectorFloat scores_;
+    std::vector<Worker> workers_;
+    std::vector<Id> block_to_global_;
+    DenseIdSet touched_groupids_;
+    Group merged_;
+    std::vector<Id> emptied_ids_;
+    SplitMerge split_merge_;
+    ValueAliasTables<Value> value_tables_;
+    size_t table_epoch_;
+    std::vector<Id> anchored_ids_;
+    std::unordered_map<Id, size_t> anchored_positions_;
+    std::unordered_map<Id, Id> reopened_ids_;
+    VectorFloat table_scores_;
+};
+
+}   // namespace distributions
@@ -28,16 +28,76 @@
 #pragma once
 
 #include <vector>
-#include <unordered_set>
-#include <unordered_map>
+#include <algorithm>
+#include <utility>
 #include <type_traits>
 #include <distributions/common.hpp>
+#include <distributions/assert_close.hpp>
 #include <distributions/vector.hpp>
-#include <distributions/trivial_hash.hpp>
 #include <distributions/random_fwd.hpp>
+#include <distributions/thread_pool.hpp>
 
 namespace distributions {
 
+// --------------------------------------------------------------------------
+// Dense Id Set
+//
+// This is a set of small nonnegative ids such as groupids, supporting O(1)
+// insert, erase, and lookup without hashing or per-node allocation.
+// Ids are stored contiguously for iteration, in no particular order.
+
+class DenseIdSet {
+ public:
+    typedef std::vector<size_t>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+    const_iterator begin() const { return ids_.begin(); }
+    const_iterator end() const { return ids_.end(); }
+
+    bool contains(size_t id) const {
+        return id < positions_.size() and positions_[id] != missing();
+    }
+
+    size_t count(size_t id) const { return contains(id); }
+
+    void clear() {
+        for (size_t id : ids_) {
+            positions_[id] = missing();
+        }
+        ids_.clear();
+    }
+
+    void insert(size_t id) {
+        if (DIST_UNLIKELY(id >= positions_.size())) {
+            positions_.resize(id + 1, missing());
+        }
+        if (positions_[id] == missing()) {
+            positions_[id] = ids_.size();
+            ids_.push_back(id);
+        }
+    }
+
+    void erase(size_t id) {
+        if (contains(id)) {
+            const size_t pos = positions_[id];
+            const size_t back = ids_.back();
+            ids_[pos] = back;
+            positions_[back] = pos;
+            ids_.pop_back();
+            positions_[id] = missing();
+        }
+    }
+
+ private:
+    static size_t missing() { return ~size_t(0); }
+
+    std::vector<size_t> ids_;
+    std::vector<size_t> positions_;
+};
+
+
 // --------------------------------------------------------------------------
 // Mixture Driver
 //
@@ -48,7 +108,7 @@ namespace distributions {
 template<class Model_, class count_t>
 struct MixtureDriver {
     typedef Model_ Model;
-    typedef std::unordered_set<size_t, TrivialHash<size_t>> IdSet;
+    typedef DenseIdSet IdSet;
 
     std::vector<count_t> & counts() { return counts_; }
     const std::vector<count_t> & counts() const { return counts_; }
@@ -154,8 +214,7 @@ struct MixtureDriver {
         if (DIST_DEBUG_LEVEL >= 2) {
             for (size_t i = 0; i < counts_.size(); ++i) {
                 bool count_is_zero = (counts_[i] == 0);
-                bool is_empty =
-                    (empty_groupids_.find(i) != empty_groupids_.end());
+                bool is_empty = empty_groupids_.contains(i);
                 DIST_ASSERT_EQ(count_is_zero, is_empty);
             }
         }
@@ -226,6 +285,7 @@ struct MixtureSlaveGroups {
 
 template<class Model_, class Derived>
 struct MixtureSlaveDataScorerMixin {
+    Derived & self() { return static_cast<Derived &>(*this); }
     const Derived & self() const {
         return static_cast<const Derived &>(*this);
     }
@@ -235,18 +295,106 @@ struct MixtureSlaveDataScorerMixin {
     typedef typename Model::Shared Shared;
     typedef typename Model::Group Group;
 
+    // A data scorer may mirror group statistics in its own columns, so that
+    // score_data and score_data_grid read contiguous arrays instead of
+    // walking groups; value scorers likewise gather group statistics into
+    // columns in update_all, so that each pass is a flat vectorizable loop.
+    // MixtureSlave keeps the columns in sync through these hooks.  Unlike
+    // value scorer caches, updates are never deferred, so scoring never
+    // writes and is safe to run from many threads.  Columns that do not
+    // match the groups being scored, e.g. those of a scorer that no
+    // MixtureSlave maintains, fall back to score_groups.
+    void resize(const Shared &, size_t) {}
+    void add_group(const Shared &) {}
+    void remove_group(const Shared &, size_t) {}
+    void update_group(const Shared &, size_t, const Group &) {}
+
+    void update_groups(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids) {
+        for (size_t i = 0; i < size; ++i) {
+            const size_t groupid = groupids[i];
+            self().update_group(shared, groupid, groups[groupid]);
+        }
+    }
+
+    void update_all(
+            const Shared & shared,
+            const std::vector<Group> & groups) {
+        for (size_t i = 0, size = groups.size(); i < size; ++i) {
+            self().update_group(shared, i, groups[i]);
+        }
+    }
+
     void score_data_grid(
             const std::vector<Shared> & shareds,
             const std::vector<Group> & groups,
             AlignedFloats scores_out,
             rng_t & rng) const {
         DIST_ASSERT_EQ(shareds.size(), scores_out.size());
-        for (size_t i = 0, size = scores_out.size(); i < size; ++i) {
+        self().score_data_grid_range(
+            shareds,
+            groups,
+            0,
+            shareds.size(),
+            scores_out.data(),
+            rng);
+    }
+
+    // Grid points are split into one contiguous slice per thread, so that
+    // scorers may update incrementally along each slice.
+    void score_data_grid(
+            const std::vector<Shared> & shareds,
+            const std::vector<Group> & groups,
+            AlignedFloats scores_out,
+            rng_t & rng,
+            ThreadPool & pool) const {
+        DIST_ASSERT_EQ(shareds.size(), scores_out.size());
+        const size_t size = shareds.size();
+        const size_t slice_count = std::min(pool.size(), size);
+        std::vector<rng_t> rngs;
+        for (size_t i = 0; i < slice_count; ++i) {
+            rngs.push_back(rng_t(rng()));
+        }
+        float * out = scores_out.data();
+        pool.parallel_for(slice_count, [&](size_t i) {
+            self().score_data_grid_range(
+                shareds,
+                groups,
+                size * i / slice_count,
+                size * (i + 1) / slice_count,
+                out,
+                rngs[i]);
+        });
+    }
+
+    // Scores grid points [begin, end) into scores_out[begin, end).
+    void score_data_grid_range(
+            const std::vector<Shared> & shareds,
+            const std::vector<Group> & groups,
+            size_t begin,
+            size_t end,
+            float * scores_out,
+            rng_t & rng) const {
+        for (size_t i = begin; i < end; ++i) {
             scores_out[i] = self().score_data(shareds[i], groups, rng);
         }
     }
 
     void validate(const Shared &, const std::vector<Group> &) const {}
+
+    static float score_groups(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) {
+        float score = 0;
+        for (const Group & group : groups) {
+            score += group.score_data(shared, rng);
+        }
+        return score;
+    }
 };
 
 template<class Model>
@@ -259,11 +407,7 @@ struct SmallMixtureSlaveDataScorer :  // NOLINT(*)
             const Shared & shared,
             const std::vector<Group> & groups,
             rng_t & rng) const {
-        float score = 0;
-        for (const Group & group : groups) {
-            score += group.score_data(shared, rng);
-        }
-        return score;
+        return this->score_groups(shared, groups, rng);
     }
 };
 
@@ -274,6 +418,17 @@ struct MixtureSlaveValueScorerMixin {
     typedef typename Model::Shared Shared;
     typedef typename Model::Group Group;
 
+    MixtureSlaveValueScorerMixin() : lazy_(false) {}
+
+    // In lazy mode, add_value and remove_value only mark groups as dirty,
+    // and the next score_value or score_value_group refreshes all dirty
+    // cache entries in one pass.  This saves work when a group changes
+    // several times between reads, e.g. remove-score-add in a Gibbs step.
+    // Lazy scorers write caches from const methods, so a lazy scorer
+    // must not be scored from multiple threads at once.
+    void set_lazy(bool lazy) { lazy_ = lazy; }
+    bool lazy() const { return lazy_; }
+
     void resize(const Shared &, size_t) {}
     void add_group(const Shared &, rng_t &) {}
     void remove_group(const Shared &, size_t) {}
@@ -294,7 +449,71 @@ struct MixtureSlaveValueScorerMixin {
             const Value &,
             rng_t &) {}
 
+    // Batched updates are called after all groups have been updated.
+    void add_values(
+            const Shared &,
+            const std::vector<Group> &,
+            size_t,
+            const size_t *,
+            const Value *,
+            rng_t &) {}
+
+    void remove_values(
+            const Shared &,
+            const std::vector<Group> &,
+            size_t,
+            const size_t *,
+            const Value *,
+            rng_t &) {}
+
+    // Refreshes dirty cache entries of a lazy scorer.
+    void flush(const Shared &, const std::vector<Group> &, rng_t &) const {}
+
     void validate(const Shared &, const std::vector<Group> &) const {}
+
+ protected:
+    const DenseIdSet & _touched_groupids(
+            size_t size,
+            const size_t * groupids) {
+        touched_groupids_.clear();
+        for (size_t i = 0; i < size; ++i) {
+            touched_groupids_.insert(groupids[i]);
+        }
+        return touched_groupids_;
+    }
+
+    // Returns true if the refresh was deferred to the next score call.
+    bool _mark_dirty(size_t groupid) {
+        if (lazy_) {
+            dirty_groupids_.insert(groupid);
+        }
+        return lazy_;
+    }
+
+    bool _mark_dirty(size_t size, const size_t * groupids) {
+        if (lazy_) {
+            for (size_t i = 0; i < size; ++i) {
+                dirty_groupids_.insert(groupids[i]);
+            }
+        }
+        return lazy_;
+    }
+
+    DenseIdSet & _dirty_groupids() const { return dirty_groupids_; }
+
+    // Call this after packed_remove(groupid) leaves group_count groups.
+    void _remove_dirty_group(size_t groupid, size_t group_count) {
+        dirty_groupids_.erase(groupid);
+        if (dirty_groupids_.contains(group_count)) {
+            dirty_groupids_.erase(group_count);
+            dirty_groupids_.insert(groupid);
+        }
+    }
+
+ private:
+    DenseIdSet touched_groupids_;
+    mutable DenseIdSet dirty_groupids_;
+    bool lazy_;
 };
 
 template<class Model>
@@ -324,15 +543,29 @@ struct SmallMixtureSlaveValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Value & value,
             AlignedFloats scores_accum,
             rng_t & rng) const {
+        if (DIST_DEBUG_LEVEL >= 2) {
+            DIST_ASSERT_EQ(scores_accum.size(), groups.size());
+        }
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            size_t begin,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
         DIST_THIS_SLOW_FALLBACK_SHOULD_BE_OVERRIDDEN
 
         if (DIST_DEBUG_LEVEL >= 2) {
-            DIST_ASSERT_EQ(scores_accum.size(), groups.size());
+            DIST_ASSERT_LE(begin + scores_accum.size(), groups.size());
         }
 
-        const size_t group_count = groups.size();
-        for (size_t i = 0; i < group_count; ++i) {
-            scores_accum[i] += groups[i].score_value(shared, value, rng);
+        const size_t size = scores_accum.size();
+        for (size_t i = 0; i < size; ++i) {
+            scores_accum[i] +=
+                groups[begin + i].score_value(shared, value, rng);
         }
     }
 };
@@ -346,16 +579,53 @@ struct MixtureSlave {
     typedef typename Model::Shared Shared;
     typedef typename Model::Group Group;
 
+    MixtureSlave() : track_score_(false), score_sum_(0) {}
+
     std::vector<Group> & groups() { return groups_.groups(); }
     Group & groups(size_t i) { return groups_.groups(i); }
     const std::vector<Group> & groups() const { return groups_.groups(); }
     const Group & groups(size_t i) const { return groups_.groups(i); }
 
+    // Group count, including empty groups
+    size_t size() const { return groups().size(); }
+
     void init(
             const Shared & shared,
             rng_t & rng) {
         value_scorer_.resize(shared, groups().size());
         value_scorer_.update_all(shared, groups(), rng);
+        data_scorer_.resize(shared, groups().size());
+        data_scorer_.update_all(shared, groups());
+        if (track_score_) {
+            _init_score(shared, rng);
+        }
+    }
+
+    void set_lazy(bool lazy) { value_scorer_.set_lazy(lazy); }
+    bool lazy() const { return value_scorer_.lazy(); }
+
+    // When tracking is enabled, the mixture maintains score_data as a
+    // running sum of per-group terms, refreshing only the groups touched
+    // by each update, so that tracked_score_data() costs O(1).
+    // Call init after modifying groups() directly.
+    void set_track_score(
+            const Shared & shared,
+            bool track_score,
+            rng_t & rng) {
+        track_score_ = track_score;
+        if (track_score_) {
+            _init_score(shared, rng);
+        } else {
+            group_scores_.clear();
+            score_sum_ = 0;
+        }
+    }
+
+    bool track_score() const { return track_score_; }
+
+    float tracked_score_data() const {
+        DIST_ASSERT1(track_score_, "score tracking is disabled");
+        return score_sum_;
     }
 
     void add_group(
@@ -365,6 +635,12 @@ struct MixtureSlave {
         groups_.add_group(shared, rng);
         value_scorer_.add_group(shared, rng);
         value_scorer_.update_group(shared, groupid, groups(groupid), rng);
+        data_scorer_.add_group(shared);
+        data_scorer_.update_group(shared, groupid, groups(groupid));
+        if (track_score_) {
+            group_scores_.packed_add(0);
+            _update_score(shared, groupid, rng);
+        }
     }
 
     void remove_group(
@@ -372,6 +648,11 @@ struct MixtureSlave {
             size_t groupid) {
         groups_.remove_group(shared, groupid);
         value_scorer_.remove_group(shared, groupid);
+        data_scorer_.remove_group(shared, groupid);
+        if (track_score_) {
+            score_sum_ -= group_scores_[groupid];
+            group_scores_.packed_remove(groupid);
+        }
     }
 
     void add_value(
@@ -381,6 +662,10 @@ struct MixtureSlave {
             rng_t & rng) {
         groups_.add_value(shared, groupid, value, rng);
         value_scorer_.add_value(shared, groupid, groups(groupid), value, rng);
+        data_scorer_.update_group(shared, groupid, groups(groupid));
+        if (track_score_) {
+            _update_score(shared, groupid, rng);
+        }
     }
 
     void remove_value(
@@ -395,6 +680,98 @@ struct MixtureSlave {
             groups(groupid),
             value,
             rng);
+        data_scorer_.update_group(shared, groupid, groups(groupid));
+        if (track_score_) {
+            _update_score(shared, groupid, rng);
+        }
+    }
+
+    // Refreshes cached scores of a group whose statistics were modified
+    // directly, e.g. by Group::merge.
+    void update_group(
+            const Shared & shared,
+            size_t groupid,
+            rng_t & rng) {
+        value_scorer_.update_group(shared, groupid, groups(groupid), rng);
+        data_scorer_.update_group(shared, groupid, groups(groupid));
+        if (track_score_) {
+            _update_score(shared, groupid, rng);
+        }
+    }
+
+    // Replaces a group's statistics, e.g. by a merge of partial groups,
+    // and refreshes its cached scores.
+    void update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) {
+        groups(groupid) = group;
+        update_group(shared, groupid, rng);
+    }
+
+    // Copies a group into group, reusing group's storage, e.g. to patch
+    // the group privately.
+    void copy_group(size_t groupid, Group & group) const {
+        group = groups(groupid);
+    }
+
+    // Merges a group into destin, as by Group::merge.
+    void merge_into(
+            const Shared & shared,
+            size_t groupid,
+            Group & destin,
+            rng_t & rng) const {
+        destin.merge(shared, groups(groupid), rng);
+    }
+
+    // Batched add_value.  This updates each group's sufficient statistics
+    // and then refreshes cached scores once per touched group.
+    // Groups must already exist, as after add_group.
+    void add_values(
+            const Shared & shared,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t & rng) {
+        for (size_t i = 0; i < size; ++i) {
+            groups_.add_value(shared, groupids[i], values[i], rng);
+        }
+        value_scorer_.add_values(
+            shared,
+            groups(),
+            size,
+            groupids,
+            values,
+            rng);
+        data_scorer_.update_groups(shared, groups(), size, groupids);
+        if (track_score_) {
+            _update_scores(shared, size, groupids, rng);
+        }
+    }
+
+    // Batched remove_value.  Groups emptied by this batch should be
+    // removed afterwards via remove_group.
+    void remove_values(
+            const Shared & shared,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t & rng) {
+        for (size_t i = 0; i < size; ++i) {
+            groups_.remove_value(shared, groupids[i], values[i], rng);
+        }
+        value_scorer_.remove_values(
+            shared,
+            groups(),
+            size,
+            groupids,
+            values,
+            rng);
+        data_scorer_.update_groups(shared, groups(), size, groupids);
+        if (track_score_) {
+            _update_scores(shared, size, groupids, rng);
+        }
     }
 
     float score_value_group(
@@ -413,6 +790,13 @@ struct MixtureSlave {
             rng);
     }
 
+    float score_data_group(
+            const Shared & shared,
+            size_t groupid,
+            rng_t & rng) const {
+        return groups(groupid).score_data(shared, rng);
+    }
+
     void score_value(
             const Shared & shared,
             const Value & value,
@@ -424,6 +808,33 @@ struct MixtureSlave {
         value_scorer_.score_value(shared, groups(), value, scores_accum, rng);
     }
 
+    // Scores groups [begin, begin + scores_accum.size()), e.g. one chunk
+    // of a parallel score.  Unlike score_value, this does not flush a
+    // lazy scorer, so call flush once before scoring chunks in parallel.
+    void score_value_range(
+            const Shared & shared,
+            const Value & value,
+            size_t begin,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        if (DIST_DEBUG_LEVEL >= 2) {
+            DIST_ASSERT_LE(begin + scores_accum.size(), groups().size());
+        }
+        value_scorer_.score_value_range(
+            shared,
+            groups(),
+            value,
+            begin,
+            scores_accum,
+            rng);
+    }
+
+    void flush(
+            const Shared & shared,
+            rng_t & rng) const {
+        value_scorer_.flush(shared, groups(), rng);
+    }
+
     float score_data(
             const Shared & shared,
             rng_t & rng) const {
@@ -437,16 +848,80 @@ struct MixtureSlave {
         data_scorer_.score_data_grid(shareds, groups(), scores_out, rng);
     }
 
+    void score_data_grid(
+            const std::vector<Shared> & shareds,
+            AlignedFloats scores_out,
+            rng_t & rng,
+            ThreadPool & pool) const {
+        data_scorer_.score_data_grid(
+            shareds,
+            groups(),
+            scores_out,
+            rng,
+            pool);
+    }
+
     void validate(const Shared & shared) const {
         groups_.validate(shared);
         value_scorer_.validate(shared, groups());
         data_scorer_.validate(shared, groups());
+        if (track_score_) {
+            DIST_ASSERT_EQ(group_scores_.size(), groups().size());
+            rng_t rng;
+            double expected = 0;
+            for (size_t i = 0, size = groups().size(); i < size; ++i) {
+                float score = groups(i).score_data(shared, rng);
+                DIST_ASSERT_CLOSE(group_scores_[i], score);
+                expected += score;
+            }
+            DIST_ASSERT_CLOSE(score_sum_, expected);
+        }
     }
 
  private:
+    void _init_score(
+            const Shared & shared,
+            rng_t & rng) {
+        const size_t size = groups().size();
+        group_scores_.resize(size);
+        score_sum_ = 0;
+        for (size_t i = 0; i < size; ++i) {
+            float score = groups(i).score_data(shared, rng);
+            group_scores_[i] = score;
+            score_sum_ += score;
+        }
+    }
+
+    void _update_score(
+            const Shared & shared,
+            size_t groupid,
+            rng_t & rng) {
+        float score = groups(groupid).score_data(shared, rng);
+        score_sum_ += static_cast<double>(score) - group_scores_[groupid];
+        group_scores_[groupid] = score;
+    }
+
+    void _update_scores(
+            const Shared & shared,
+            size_t size,
+            const size_t * groupids,
+            rng_t & rng) {
+        touched_groupids_.clear();
+        for (size_t i = 0; i < size; ++i) {
+            touched_groupids_.insert(groupids[i]);
+        }
+        for (size_t groupid : touched_groupids_) {
+            _update_score(shared, groupid, rng);
+        }
+    }
+
     MixtureSlaveGroups<Shared> groups_;
     ValueScorer value_scorer_;
     DataScorer data_scorer_;
+    bool track_score_;
+    double score_sum_;
+    Packed_<float> group_scores_;
+    DenseIdSet touched_groupids_;
 };
 
 
@@ -463,7 +938,9 @@ struct MixtureIdTracker {
     void init(size_t group_count = 0) {
         packed_to_global_.clear();
         global_to_packed_.clear();
-        global_size_ = 0;
+        survivors_.clear();
+        survivor_shift_ = 0;
+        global_offset_ = 0;
         for (size_t i = 0; i < group_count; ++i) {
             add_group();
         }
@@ -471,26 +948,23 @@ struct MixtureIdTracker {
 
     void add_group() {
         const Id packed = packed_to_global_.size();
-        const Id global = global_size_++;
+        const Id global = global_size();
         packed_to_global_.packed_add(global);
-        global_to_packed_.insert(std::make_pair(global, packed));
+        global_to_packed_.push_back(packed);
     }
 
     void remove_group(Id packed) {
         DIST_ASSERT1(packed < packed_size(), "bad packed id: " << packed);
         const Id global = packed_to_global_[packed];
-        DIST_ASSERT1(global < global_size(), "bad global id: " << global);
-        global_to_packed_.erase(global);
+        _global_to_packed(global) = tombstone();
         packed_to_global_.packed_remove(packed);
         if (packed != packed_size()) {
             const Id global = packed_to_global_[packed];
-            DIST_ASSERT1(global < global_size(), "bad global id: " << global);
-            auto i = global_to_packed_.find(global);
-            DIST_ASSERT1(
-                i != global_to_packed_.end(),
-                "stale global id: " << global);
-            i->second = packed;
+            Id & moved = _global_to_packed(global);
+            DIST_ASSERT1(moved != tombstone(), "stale global id: " << global);
+            moved = packed;
         }
+        _compact();
     }
 
     Id packed_to_global(Id packed) const {
@@ -502,22 +976,154 @@ struct MixtureIdTracker {
 
     Id global_to_packed(Id global) const {
         DIST_ASSERT1(global < global_size(), "bad global id: " << global);
-        auto i = global_to_packed_.find(global);
-        DIST_ASSERT1(
-            i != global_to_packed_.end(),
-            "stale global id: " << global);
-        Id packed = i->second;
+        Id packed = _lookup(global);
+        DIST_ASSERT1(packed != tombstone(), "stale global id: " << global);
         DIST_ASSERT1(packed < packed_size(), "bad packed id: " << packed);
         return packed;
     }
 
+    // Returns false for global ids whose groups have been removed.
+    bool contains_global(Id global) const {
+        return global < global_size() and _lookup(global) != tombstone();
+    }
+
+    // Batched translation, e.g. when persisting a column of assignments
+    void packed_to_global(size_t size, const Id * packed, Id * global) const {
+        for (size_t i = 0; i < size; ++i) {
+            global[i] = packed_to_global(packed[i]);
+        }
+    }
+
+    void global_to_packed(size_t size, const Id * global, Id * packed) const {
+        for (size_t i = 0; i < size; ++i) {
+            packed[i] = global_to_packed(global[i]);
+        }
+    }
+
     size_t packed_size() const { return packed_to_global_.size(); }
-    size_t global_size() const { return global_size_; }
+    size_t global_size() const {
+        return global_offset_ + global_to_packed_.size();
+    }
+
+    // Number of entries held for global-to-packed lookup, including
+    // free survivor slots.
+    size_t table_size() const {
+        return global_to_packed_.size() + survivors_.size();
+    }
 
  private:
+    typedef std::pair<Id, Id> Survivor;  // (global, packed)
+
+    static Id tombstone() { return ~Id(0); }
+
+    // Below this the table is never compacted.
+    static const size_t min_table_size = 64;
+
+    Id _lookup(Id global) const {
+        if (DIST_LIKELY(global >= global_offset_)) {
+            return global_to_packed_[global - global_offset_];
+        }
+        const Survivor * survivor = _find_survivor(global);
+        return survivor ? survivor->second : tombstone();
+    }
+
+    Id & _global_to_packed(Id global) {
+        DIST_ASSERT1(global < global_size(), "bad global id: " << global);
+        if (DIST_LIKELY(global >= global_offset_)) {
+            return global_to_packed_[global - global_offset_];
+        }
+        const Survivor * survivor = _find_survivor(global);
+        DIST_ASSERT1(survivor, "stale global id: " << global);
+        return const_cast<Survivor *>(survivor)->second;
+    }
+
+    // Survivors are open-addressed by a Fibonacci hash of the global id
+    // and probed linearly; free slots have a tombstone global id.  A
+    // removed survivor keeps its slot, with a tombstone packed id, until
+    // the next compaction, so probes never need to skip deleted slots.
+    const Survivor * _find_survivor(Id global) const {
+        if (survivors_.empty()) {
+            return nullptr;
+        }
+        const size_t mask = survivors_.size() - 1;
+        size_t slot = _survivor_slot(global);
+        while (true) {
+            const Survivor & survivor = survivors_[slot];
+            if (survivor.first == global) {
+                return & survivor;
+            }
+            if (survivor.first == tombstone()) {
+                return nullptr;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    size_t _survivor_slot(Id global) const {
+        return static_cast<Id>(global * 2654435769U) >> survivor_shift_;
+    }
+
+    // The dense table covers global ids [global_offset_, global_size()).
+    // Under Pitman-Yor churn, old large groups outlive new small ones, so
+    // dead ids are scattered rather than a prefix.  Once table_size()
+    // exceeds five times the live group count, the dense table is cut to
+    // the newest 2 * packed_size() ids, and older live ids are rehashed
+    // into survivors_ at most 3/4 full.  That leaves under 14/3 entries
+    // per live group, so a rebuild costs O(table) and needs O(table) adds
+    // or removes to retrigger: memory stays O(packed_size()) at amortized
+    // O(1) cost, and every lookup is one array access or one short probe.
+    void _compact() {
+        const size_t size = global_to_packed_.size();
+        const size_t live = packed_size();
+        if (DIST_LIKELY(table_size() <= 5 * live + min_table_size)) {
+            return;
+        }
+        std::vector<Survivor> survivors;
+        for (const Survivor & survivor : survivors_) {
+            if (survivor.first != tombstone() and
+                    survivor.second != tombstone()) {
+                survivors.push_back(survivor);
+            }
+        }
+        const size_t cut = size - std::min(size, 2 * live);
+        for (size_t i = 0; i < cut; ++i) {
+            const Id packed = global_to_packed_[i];
+            if (packed != tombstone()) {
+                const Id global = global_offset_ + i;
+                survivors.push_back(Survivor(global, packed));
+            }
+        }
+        global_to_packed_.erase(
+            global_to_packed_.begin(),
+            global_to_packed_.begin() + cut);
+        global_offset_ += cut;
+
+        survivors_.clear();
+        if (survivors.empty()) {
+            return;
+        }
+        size_t capacity = 2;
+        survivor_shift_ = 31;
+        while (4 * survivors.size() > 3 * capacity) {
+            capacity *= 2;
+            --survivor_shift_;
+        }
+        survivors_.resize(capacity, Survivor(tombstone(), tombstone()));
+        const size_t mask = capacity - 1;
+        for (const Survivor & survivor : survivors) {
+            size_t slot = _survivor_slot(survivor.first);
+            while (survivors_[slot].first != tombstone()) {
+                slot = (slot + 1) & mask;
+            }
+            survivors_[slot] = survivor;
+        }
+    }
+
     Packed_<Id> packed_to_global_;
-    std::unordered_map<Id, Id, TrivialHash<Id>> global_to_packed_;
-    size_t global_size_;
+    std::vector<Id> global_to_packed_;  // indexed by global - global_offset_
+    std::vector<Survivor> survivors_;   // ids below global_offset_
+    size_t survivor_shift_;             // 32 - log2(survivors_.size())
+    size_t global_offset_;
 };
 
 }   // namespace distributions
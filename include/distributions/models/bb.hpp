@@ -31,6 +31,7 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
 #include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
@@ -242,6 +243,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     void remove_group(const Shared &, size_t groupid) {
         heads_scores_.packed_remove(groupid);
         tails_scores_.packed_remove(groupid);
+        _remove_dirty_group(groupid, heads_scores_.size());
     }
 
     void update_group(
@@ -261,7 +263,9 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
     void remove_value(
@@ -270,13 +274,40 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
+    }
+
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t &) {
+        if (not _mark_dirty(size, groupids)) {
+            _update_groups(shared, groups, _touched_groupids(size, groupids));
+        }
+    }
+
+    void remove_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t &) {
+        if (not _mark_dirty(size, groupids)) {
+            _update_groups(shared, groups, _touched_groupids(size, groupids));
+        }
     }
 
     void update_all(
             const Shared & shared,
             const std::vector<Group> & groups,
             rng_t &) {
+        _dirty_groupids().clear();
         const size_t group_count = groups.size();
         heads_scores_.resize(group_count);
         tails_scores_.resize(group_count);
@@ -292,24 +323,48 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     }
 
     float score_value_group(
-            const Shared &,
-            const std::vector<Group> &,
+            const Shared & shared,
+            const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
+        flush(shared, groups, rng);
         return value ? heads_scores_[groupid] : tails_scores_[groupid];
     }
 
     void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
             const Shared &,
             const std::vector<Group> &,
             const Value & value,
+            size_t begin,
             AlignedFloats scores_accum,
             rng_t &) const {
+        const VectorFloat & scores = value ? heads_scores_ : tails_scores_;
         vector_add(
             scores_accum.size(),
             scores_accum.data(),
-            (value ? heads_scores_.data() : tails_scores_.data()));
+            scores.data() + begin);
+    }
+
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) const {
+        DenseIdSet & dirty = _dirty_groupids();
+        if (DIST_UNLIKELY(not dirty.empty())) {
+            _update_groups(shared, groups, dirty);
+            dirty.clear();
+        }
     }
 
     void validate(
@@ -320,8 +375,34 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     }
 
  private:
-    VectorFloat heads_scores_;
-    VectorFloat tails_scores_;
+    void _update_groups(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const DenseIdSet & groupids) const {
+        const size_t size = groupids.size();
+        Scratch scratch;
+        float * __restrict__ heads_temp = scratch.floats(2 * size).data();
+        float * __restrict__ tails_temp = heads_temp + size;
+        size_t i = 0;
+        for (size_t groupid : groupids) {
+            const Group & group = groups[groupid];
+            float heads = shared.alpha + group.heads;
+            float tails = shared.beta + group.tails;
+            heads_temp[i] = heads / (heads + tails);
+            tails_temp[i] = tails / (heads + tails);
+            ++i;
+        }
+        vector_log(2 * size, heads_temp);
+        i = 0;
+        for (size_t groupid : groupids) {
+            heads_scores_[groupid] = heads_temp[i];
+            tails_scores_[groupid] = tails_temp[i];
+            ++i;
+        }
+    }
+
+    mutable VectorFloat heads_scores_;
+    mutable VectorFloat tails_scores_;
 };
 };  // struct BetaBernoulli
 }   // namespace distributions
@@ -31,7 +31,9 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
+#include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
 #include <distributions/mixture.hpp>
 
@@ -175,20 +177,29 @@ struct Group : GroupMixin<Model> {
 };
 
 struct Sampler {
-    float beta;
+    NegativeBinomialSampler negative_binomial;
 
     void init(
             const Shared & shared,
             const Group & group,
             rng_t & rng) {
         Shared post = shared.plus_group(group);
-        beta = sample_beta(rng, post.alpha, post.beta);
+        float beta = sample_beta(rng, post.alpha, post.beta);
+        negative_binomial.init(beta, shared.r);
     }
 
     Value eval(
-            const Shared & shared,
+            const Shared &,
+            rng_t & rng) const {
+        return negative_binomial.eval(rng);
+    }
+
+    void eval(
+            const Shared &,
+            size_t size,
+            Value * values,
             rng_t & rng) const {
-        return sample_negative_binomial(rng, beta, shared.r);
+        negative_binomial.fill(rng, size, values);
     }
 };
 
@@ -221,44 +232,105 @@ struct Scorer {
 
 struct MixtureDataScorer
     : MixtureSlaveDataScorerMixin<Model, MixtureDataScorer> {
+    void resize(const Shared &, size_t size) {
+        count_.resize(size);
+        sum_.resize(size);
+    }
+
+    void add_group(const Shared &) {
+        count_.packed_add(0);
+        sum_.packed_add(0);
+    }
+
+    void remove_group(const Shared &, size_t groupid) {
+        count_.packed_remove(groupid);
+        sum_.packed_remove(groupid);
+    }
+
+    void update_group(
+            const Shared &,
+            size_t groupid,
+            const Group & group) {
+        count_[groupid] = group.count;
+        sum_[groupid] = group.sum;
+    }
+
     float score_data(
             const Shared & shared,
             const std::vector<Group> & groups,
-            rng_t &) const {
+            rng_t & rng) const {
+        if (DIST_UNLIKELY(count_.size() != groups.size())) {
+            return score_groups(shared, groups, rng);
+        }
         const float shared_part = fast_lgamma(shared.alpha + shared.beta)
                                 - fast_lgamma(shared.alpha)
                                 - fast_lgamma(shared.beta);
+
+        const size_t size = count_.size();
+        Scratch scratch;
+        float * __restrict__ temp = scratch.floats(3 * size).data();
+        float * __restrict__ lgamma_alpha = temp;
+        float * __restrict__ lgamma_beta = temp + size;
+        float * __restrict__ lgamma_alpha_beta = temp + 2 * size;
+        const float * __restrict__ count = VectorFloat_data(count_);
+        const float * __restrict__ sum = VectorFloat_data(sum_);
+        const float r = shared.r;
+        for (size_t i = 0; i < size; ++i) {
+            lgamma_alpha[i] = shared.alpha + r * count[i];
+            lgamma_beta[i] = shared.beta + sum[i];
+            lgamma_alpha_beta[i] = lgamma_alpha[i] + lgamma_beta[i];
+        }
+        vector_lgamma(3 * size, temp);
+
         float score = 0;
-        for (auto const & group : groups) {
-            if (group.count) {
-                Shared post = shared.plus_group(group);
-                score += fast_lgamma(post.alpha)
-                       + fast_lgamma(post.beta)
-                       - fast_lgamma(post.alpha + post.beta);
-                score += shared_part;
-            }
+        for (size_t i = 0; i < size; ++i) {
+            float group_score = lgamma_alpha[i]
+                              + lgamma_beta[i]
+                              - lgamma_alpha_beta[i]
+                              + shared_part;
+            score += count[i] ? group_score : 0.f;
         }
         return score;
     }
+
+    void validate(
+            const Shared &,
+            const std::vector<Group> & groups) const {
+        const size_t size = groups.size();
+        DIST_ASSERT_EQ(count_.size(), size);
+        DIST_ASSERT_EQ(sum_.size(), size);
+        for (size_t i = 0; i < size; ++i) {
+            DIST_ASSERT_EQ(count_[i], groups[i].count);
+            DIST_ASSERT_EQ(sum_[i], groups[i].sum);
+        }
+    }
+
+ private:
+    VectorFloat count_;
+    VectorFloat sum_;
 };
 
 struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     void resize(const Shared &, size_t size) {
         score_.resize(size);
+        zero_score_.resize(size);
         post_beta_.resize(size);
         alpha_.resize(size);
     }
 
     void add_group(const Shared &, rng_t &) {
         score_.packed_add();
+        zero_score_.packed_add();
         post_beta_.packed_add();
         alpha_.packed_add();
     }
 
     void remove_group(const Shared &, size_t groupid) {
         score_.packed_remove(groupid);
+        zero_score_.packed_remove(groupid);
         post_beta_.packed_remove(groupid);
         alpha_.packed_remove(groupid);
+        _remove_dirty_group(groupid, score_.size());
     }
 
     void update_group(
@@ -266,12 +338,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             size_t groupid,
             const Group & group,
             rng_t & rng) {
-        Model::Scorer base;
-        base.init(shared, group, rng);
-
-        score_[groupid] = base.score;
-        post_beta_[groupid] = base.post_beta;
-        alpha_[groupid] = base.alpha;
+        _update_group(shared, groupid, group, rng);
     }
 
     void add_value(
@@ -280,7 +347,9 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
     void remove_value(
@@ -289,40 +358,128 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
-    void update_all(
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t & rng) {
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void remove_values(
             const Shared & shared,
             const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
             rng_t & rng) {
-        const size_t group_count = groups.size();
-        for (size_t groupid = 0; groupid < group_count; ++groupid) {
-            update_group(shared, groupid, groups[groupid], rng);
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void update_all(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) {
+        _dirty_groupids().clear();
+        const size_t size = groups.size();
+        Scratch scratch;
+        float * __restrict__ temp = scratch.floats(5 * size).data();
+        float * __restrict__ lgamma_post_alpha_beta = temp;
+        float * __restrict__ lgamma_post_alpha = temp + size;
+        float * __restrict__ lgamma_post_beta = temp + 2 * size;
+        float * __restrict__ lgamma_alpha = temp + 3 * size;
+        float * __restrict__ lgamma_post_beta_alpha = temp + 4 * size;
+        float * __restrict__ post_beta = VectorFloat_data(post_beta_);
+        float * __restrict__ alpha = VectorFloat_data(alpha_);
+        const float r = shared.r;
+        for (size_t i = 0; i < size; ++i) {
+            const Group & group = groups[i];
+            lgamma_post_alpha[i] = shared.alpha + r * group.count;
+            post_beta[i] = shared.beta + group.sum;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            lgamma_post_alpha_beta[i] = lgamma_post_alpha[i] + post_beta[i];
+            lgamma_post_beta[i] = post_beta[i];
+            alpha[i] = lgamma_alpha[i] = lgamma_post_alpha[i] + r;
+            lgamma_post_beta_alpha[i] = post_beta[i] + alpha[i];
+        }
+        vector_lgamma(5 * size, temp);
+        float * __restrict__ score = VectorFloat_data(score_);
+        float * __restrict__ zero_score = VectorFloat_data(zero_score_);
+        for (size_t i = 0; i < size; ++i) {
+            score[i] = lgamma_post_alpha_beta[i]
+                     - lgamma_post_alpha[i]
+                     - lgamma_post_beta[i]
+                     + lgamma_alpha[i];
+            zero_score[i] = score[i]
+                          + lgamma_post_beta[i]
+                          - lgamma_post_beta_alpha[i];
         }
     }
 
     float score_value_group(
-            const Shared &,
-            const std::vector<Group> &,
+            const Shared & shared,
+            const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
+        flush(shared, groups, rng);
         float beta = post_beta_[groupid] + value;
         return score_[groupid] + fast_lgamma(beta)
                                - fast_lgamma(beta + alpha_[groupid]);
     }
 
     void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
             const Shared &,
             const std::vector<Group> &,
             const Value & value,
+            size_t begin,
             AlignedFloats scores_accum,
-            rng_t &) const {
-        for (size_t i = 0, size = scores_accum.size(); i < size; ++i) {
-            float beta = post_beta_[i] + value;
-            scores_accum[i] += score_[i] + fast_lgamma(beta)
-                                         - fast_lgamma(beta + alpha_[i]);
+            rng_t &) const;
+
+    // Values below this are scored relative to zero_score_, the score of
+    // value 0, by the product of ratios
+    //   [lgamma(b + v) - lgamma(b + a + v)] - [lgamma(b) - lgamma(b + a)]
+    //     = log prod_{i < v} (b + i) / (b + a + i),
+    // where b = post_beta_ and a = alpha_, so only one log is needed.
+    static const Value small_value_limit = 4;
+
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) const {
+        DenseIdSet & dirty = _dirty_groupids();
+        if (DIST_UNLIKELY(not dirty.empty())) {
+            for (size_t groupid : dirty) {
+                _update_group(shared, groupid, groups[groupid], rng);
+            }
+            dirty.clear();
         }
     }
 
@@ -330,14 +487,32 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Shared &,
             const std::vector<Group> & groups) const {
         DIST_ASSERT_EQ(score_.size(), groups.size());
+        DIST_ASSERT_EQ(zero_score_.size(), groups.size());
         DIST_ASSERT_EQ(post_beta_.size(), groups.size());
         DIST_ASSERT_EQ(alpha_.size(), groups.size());
     }
 
  private:
-    VectorFloat score_;
-    VectorFloat post_beta_;
-    VectorFloat alpha_;
+    void _update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) const {
+        Model::Scorer base;
+        base.init(shared, group, rng);
+
+        score_[groupid] = base.score;
+        zero_score_[groupid] = base.score
+                             + fast_lgamma(base.post_beta)
+                             - fast_lgamma(base.post_beta + base.alpha);
+        post_beta_[groupid] = base.post_beta;
+        alpha_[groupid] = base.alpha;
+    }
+
+    mutable VectorFloat score_;
+    mutable VectorFloat zero_score_;
+    mutable VectorFloat post_beta_;
+    mutable VectorFloat alpha_;
 };
 };  // struct BetaNegativeBinomial
 }   // namespace distributions
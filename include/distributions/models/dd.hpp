@@ -31,6 +31,7 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
 #include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
@@ -155,6 +156,7 @@ struct Group : GroupMixin<Model> {
         for (Value value = 0; value < dim; ++value) {
             counts[value] += source.counts[value];
         }
+        count_sum += source.count_sum;
     }
 
     float score_value(
@@ -246,101 +248,141 @@ struct Scorer {
 
 struct MixtureDataScorer
     : MixtureSlaveDataScorerMixin<Model, MixtureDataScorer> {
-    // not thread safe
+    // Temporaries come from per-thread Scratch, so threads may score
+    // concurrently, e.g. slices of a parallel score_data_grid.
     float score_data(
             const Shared & shared,
             const std::vector<Group> & groups,
             rng_t &) const {
-        _init(shared, groups);
-        return _eval();
+        const size_t size = shared.dim + 1;
+        Scratch scratch;
+        float * shared_part = scratch.floats(size).data();
+        float * scores = scratch.floats(size).data();
+        double alpha_sum;
+        _init(shared, groups, alpha_sum, shared_part, scores);
+        return vector_sum(size, scores);
     }
 
-    // not thread safe
-    void score_data_grid(
+    void score_data_grid_range(
             const std::vector<Shared> & shareds,
             const std::vector<Group> & groups,
-            AlignedFloats scores_out,
+            size_t begin,
+            size_t end,
+            float * scores_out,
             rng_t &) const {
-        DIST_ASSERT_EQ(shareds.size(), scores_out.size());
-        if (const size_t size = shareds.size()) {
-            const int dim = shareds[0].dim;
-
-            _init(shareds[0], groups);
-            scores_out[0] = _eval();
-
-            for (size_t i = 1; i < size; ++i) {
-                const float * old_alphas = shareds[i-1].alphas;
-                const float * new_alphas = shareds[i].alphas;
-                for (Value value = 0; value < dim; ++value) {
-                    const float & old_alpha = old_alphas[value];
-                    const float & new_alpha = new_alphas[value];
-                    if (DIST_UNLIKELY(new_alpha != old_alpha)) {
-                        _update(value, old_alpha, new_alpha, groups);
-                    }
+        if (begin == end) {
+            return;
+        }
+        const size_t size = shareds[begin].dim + 1;
+        Scratch scratch;
+        float * shared_part = scratch.floats(size).data();
+        float * scores = scratch.floats(size).data();
+        double alpha_sum;
+        _score_grid(
+            shareds,
+            groups,
+            begin,
+            end,
+            scores_out,
+            alpha_sum,
+            shared_part,
+            scores);
+    }
+
+ private:
+    // shared_part and scores each hold dim + 1 floats: one per value,
+    // then one for the alpha_sum terms.
+    static void _score_grid(
+            const std::vector<Shared> & shareds,
+            const std::vector<Group> & groups,
+            size_t begin,
+            size_t end,
+            float * scores_out,
+            double & alpha_sum,
+            float * shared_part,
+            float * scores) {
+        const int dim = shareds[begin].dim;
+        const size_t size = dim + 1;
+
+        _init(shareds[begin], groups, alpha_sum, shared_part, scores);
+        scores_out[begin] = vector_sum(size, scores);
+
+        for (size_t i = begin + 1; i < end; ++i) {
+            const float * old_alphas = shareds[i-1].alphas;
+            const float * new_alphas = shareds[i].alphas;
+            for (Value value = 0; value < dim; ++value) {
+                const float & old_alpha = old_alphas[value];
+                const float & new_alpha = new_alphas[value];
+                if (DIST_UNLIKELY(new_alpha != old_alpha)) {
+                    _update(
+                        dim,
+                        value,
+                        old_alpha,
+                        new_alpha,
+                        groups,
+                        alpha_sum,
+                        shared_part,
+                        scores);
                 }
-                scores_out[i] = _eval();
             }
+            scores_out[i] = vector_sum(size, scores);
         }
     }
 
- private:
-    void _init(
+    static void _init(
             const Shared & shared,
-            const std::vector<Group> & groups) const {
+            const std::vector<Group> & groups,
+            double & alpha_sum_out,
+            float * shared_part,
+            float * scores) {
         const size_t dim = shared.dim;
-        shared_part_.resize(dim + 1);
         float alpha_sum = 0;
         for (size_t i = 0; i < dim; ++i) {
             float alpha = shared.alphas[i];
             alpha_sum += alpha;
-            shared_part_[i] = fast_lgamma(alpha);
+            shared_part[i] = fast_lgamma(alpha);
         }
-        alpha_sum_ = alpha_sum;
-        shared_part_.back() = fast_lgamma(alpha_sum);
+        alpha_sum_out = alpha_sum;
+        shared_part[dim] = fast_lgamma(alpha_sum);
 
-        scores_.resize(0);
-        scores_.resize(dim + 1, 0);
+        vector_zero(dim + 1, scores);
         for (auto const & group : groups) {
             if (group.count_sum) {
                 for (size_t i = 0; i < dim; ++i) {
                     float alpha = shared.alphas[i];
-                    scores_[i] += fast_lgamma(alpha + group.counts[i])
-                               - shared_part_[i];
+                    scores[i] += fast_lgamma(alpha + group.counts[i])
+                              - shared_part[i];
                 }
-                scores_.back() += shared_part_.back()
-                               - fast_lgamma(alpha_sum + group.count_sum);
+                scores[dim] += shared_part[dim]
+                            - fast_lgamma(alpha_sum + group.count_sum);
             }
         }
     }
 
-    float _eval() const {
-        return vector_sum(scores_.size(), scores_.data());
-    }
-
-    void _update(
+    static void _update(
+            size_t dim,
             Value value,
             float old_alpha,
             float new_alpha,
-            const std::vector<Group> & groups) const {
-        shared_part_[value] = fast_lgamma(new_alpha);
-        alpha_sum_ += static_cast<double>(new_alpha)
-                    - static_cast<double>(old_alpha);
-        const float alpha_sum = alpha_sum_;
-        shared_part_.back() = fast_lgamma(alpha_sum);
-
-        scores_[value] = 0;
-        scores_.back() = 0;
+            const std::vector<Group> & groups,
+            double & alpha_sum_inout,
+            float * shared_part,
+            float * scores) {
+        shared_part[value] = fast_lgamma(new_alpha);
+        alpha_sum_inout += static_cast<double>(new_alpha)
+                         - static_cast<double>(old_alpha);
+        const float alpha_sum = alpha_sum_inout;
+        shared_part[dim] = fast_lgamma(alpha_sum);
+
+        scores[value] = 0;
+        scores[dim] = 0;
         for (auto const & group : groups) {
-            scores_[value] += fast_lgamma(new_alpha + group.counts[value])
-                           - shared_part_[value];
-            scores_.back() += shared_part_.back()
-                           - fast_lgamma(alpha_sum + group.count_sum);
+            scores[value] += fast_lgamma(new_alpha + group.counts[value])
+                          - shared_part[value];
+            scores[dim] += shared_part[dim]
+                        - fast_lgamma(alpha_sum + group.count_sum);
         }
     }
-
-    mutable double alpha_sum_;
-    mutable VectorFloat shared_part_;
-    mutable VectorFloat scores_;
 };
 
 struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
@@ -364,6 +406,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
         for (Value value = 0; value < shared.dim; ++value) {
             scores_[value].packed_remove(groupid);
         }
+        this->_remove_dirty_group(groupid, scores_shift_.size());
     }
 
     void update_group(
@@ -384,7 +427,9 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value & value,
             rng_t &) {
-        _update_group_value(shared, groupid, group, value);
+        if (not this->_mark_dirty(groupid)) {
+            _update_group_value(shared, groupid, group, value);
+        }
     }
 
     void remove_value(
@@ -393,13 +438,40 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value & value,
             rng_t &) {
-        _update_group_value(shared, groupid, group, value);
+        if (not this->_mark_dirty(groupid)) {
+            _update_group_value(shared, groupid, group, value);
+        }
+    }
+
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t &) {
+        if (not this->_mark_dirty(size, groupids)) {
+            _update_group_values(shared, groups, size, groupids, values);
+        }
+    }
+
+    void remove_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t &) {
+        if (not this->_mark_dirty(size, groupids)) {
+            _update_group_values(shared, groups, size, groupids, values);
+        }
     }
 
     void update_all(
             const Shared & shared,
             const std::vector<Group> & groups,
             rng_t &) {
+        this->_dirty_groupids().clear();
         const size_t group_count = groups.size();
 
         alpha_sum_ = 0;
@@ -422,26 +494,69 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
 
     float score_value_group(
             const Shared & shared,
-            const std::vector<Group> &,
+            const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
         DIST_ASSERT1(value < shared.dim, "value out of bounds: " << value);
+        flush(shared, groups, rng);
         return scores_[value][groupid] - scores_shift_[groupid];
     }
 
     void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
             const Shared & shared,
             const std::vector<Group> &,
             const Value & value,
+            size_t begin,
             AlignedFloats scores_accum,
             rng_t &) const {
         DIST_ASSERT1(value < shared.dim, "value out of bounds: " << value);
         vector_add_subtract(
             scores_accum.size(),
             scores_accum.data(),
-            scores_[value].data(),
-            scores_shift_.data());
+            scores_[value].data() + begin,
+            scores_shift_.data() + begin);
+    }
+
+    // Dirty groups are refreshed whole, dim + 1 entries per group.
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) const {
+        DenseIdSet & dirty = this->_dirty_groupids();
+        if (DIST_LIKELY(dirty.empty())) {
+            return;
+        }
+        const size_t size = (shared.dim + 1) * dirty.size();
+        Scratch scratch;
+        float * __restrict__ const temps = scratch.floats(size).data();
+        float * __restrict__ temp = temps;
+        for (size_t groupid : dirty) {
+            const Group & group = groups[groupid];
+            for (Value value = 0; value < shared.dim; ++value) {
+                *temp++ = shared.alphas[value] + group.counts[value];
+            }
+            *temp++ = alpha_sum_ + group.count_sum;
+        }
+        vector_log(size, temps);
+        temp = temps;
+        for (size_t groupid : dirty) {
+            for (Value value = 0; value < shared.dim; ++value) {
+                scores_[value][groupid] = *temp++;
+            }
+            scores_shift_[groupid] = *temp++;
+        }
+        dirty.clear();
     }
 
     void validate(
@@ -466,9 +581,39 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
         scores_shift_[groupid] = fast_log(alpha_sum_ + group.count_sum);
     }
 
+    void _update_group_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values) {
+        const DenseIdSet & touched = this->_touched_groupids(size, groupids);
+        Scratch scratch;
+        float * __restrict__ temp =
+            scratch.floats(size + touched.size()).data();
+        for (size_t i = 0; i < size; ++i) {
+            const Value value = values[i];
+            DIST_ASSERT1(value < shared.dim, "value out of bounds: " << value);
+            const Group & group = groups[groupids[i]];
+            temp[i] = shared.alphas[value] + group.counts[value];
+        }
+        size_t i = size;
+        for (size_t groupid : touched) {
+            temp[i++] = alpha_sum_ + groups[groupid].count_sum;
+        }
+        vector_log(size + touched.size(), temp);
+        for (size_t i = 0; i < size; ++i) {
+            scores_[values[i]][groupids[i]] = temp[i];
+        }
+        i = size;
+        for (size_t groupid : touched) {
+            scores_shift_[groupid] = temp[i++];
+        }
+    }
+
     float alpha_sum_;
-    std::vector<VectorFloat> scores_;
-    VectorFloat scores_shift_;
+    mutable std::vector<VectorFloat> scores_;
+    mutable VectorFloat scores_shift_;
 };
 };  // struct DirichletDiscrete
 }   // namespace distributions
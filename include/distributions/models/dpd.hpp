@@ -28,11 +28,13 @@
 #pragma once
 
 #include <vector>
+#include <utility>
 #include <algorithm>
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
 #include <distributions/sparse.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
 #include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
@@ -409,6 +411,8 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             i.second.scores.packed_remove(groupid);
         }
         scores_shift_.packed_remove(groupid);
+        _remove_dirty_group(groupid, scores_shift_.size());
+        _remove_dirty_values(groupid, scores_shift_.size());
     }
 
     void update_group(
@@ -441,11 +445,15 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const float beta = shared.alpha * shared.betas.get(value);
             entry.scores.resize(group_count, fast_log(beta));
         }
-        entry.scores[groupid] = fast_log(
-            shared.alpha * shared.betas.get(value) +
-            group.counts.get_count(value));
-        scores_shift_[groupid] = fast_log(
-            shared.alpha + group.counts.get_total());
+        if (_mark_dirty(groupid)) {
+            dirty_values_.push_back(std::make_pair(value, groupid));
+        } else {
+            entry.scores[groupid] = fast_log(
+                shared.alpha * shared.betas.get(value) +
+                group.counts.get_count(value));
+            scores_shift_[groupid] = fast_log(
+                shared.alpha + group.counts.get_total());
+        }
     }
 
     void remove_value(
@@ -459,13 +467,70 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
         --entry.ref_count;
         if (DIST_UNLIKELY(entry.ref_count == 0)) {
             scores_.remove(value);
+            if (not _mark_dirty(groupid)) {
+                scores_shift_[groupid] = fast_log(
+                    shared.alpha + group.counts.get_total());
+            }
+        } else if (_mark_dirty(groupid)) {
+            dirty_values_.push_back(std::make_pair(value, groupid));
         } else {
             entry.scores[groupid] = fast_log(
                 shared.alpha * shared.betas.get(value) +
                 group.counts.get_count(value));
+            scores_shift_[groupid] = fast_log(
+                shared.alpha + group.counts.get_total());
+        }
+    }
+
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t &) {
+        const size_t group_count = scores_shift_.size();
+        for (size_t i = 0; i < size; ++i) {
+            const Value value = values[i];
+            DIST_ASSERT1(value != OTHER(), "cannot add OTHER");
+            auto & entry = scores_.get_or_add(value);
+            ++entry.ref_count;
+            if (DIST_UNLIKELY(entry.ref_count == 1)) {
+                const float beta = shared.alpha * shared.betas.get(value);
+                entry.scores.resize(group_count, fast_log(beta));
+            }
+        }
+        if (_mark_dirty(size, groupids)) {
+            _push_dirty_values(size, groupids, values);
+        } else {
+            _update_group_values(shared, groups, size, groupids, values);
+        }
+    }
+
+    void remove_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t &) {
+        for (size_t i = 0; i < size; ++i) {
+            DIST_ASSERT1(values[i] != OTHER(), "cannot remove OTHER");
+            --scores_.get(values[i]).ref_count;
+        }
+        if (_mark_dirty(size, groupids)) {
+            _push_dirty_values(size, groupids, values);
+        } else {
+            _update_group_values(shared, groups, size, groupids, values);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            const Value value = values[i];
+            if (scores_.contains(value)) {
+                if (DIST_UNLIKELY(scores_.get(value).ref_count == 0)) {
+                    scores_.remove(value);
+                }
+            }
         }
-        scores_shift_[groupid] = fast_log(
-            shared.alpha + group.counts.get_total());
     }
 
     void update_all(
@@ -473,6 +538,8 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const std::vector<Group> & groups,
             rng_t &) {
         _validate(shared, groups.size());
+        _dirty_groupids().clear();
+        dirty_values_.clear();
         const size_t group_count = groups.size();
         const float alpha = shared.alpha;
 
@@ -501,7 +568,8 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
+        flush(shared, groups, rng);
         _validate(shared, groups.size());
 
         if (DIST_LIKELY(scores_.contains(value))) {
@@ -519,6 +587,17 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const std::vector<Group> & groups,
             const Value & value,
             AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            size_t begin,
+            AlignedFloats scores_accum,
             rng_t &) const {
         _validate(shared, groups.size());
 
@@ -526,8 +605,8 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             vector_add_subtract(
                 scores_accum.size(),
                 scores_accum.data(),
-                scores_.get(value).scores.data(),
-                scores_shift_.data());
+                scores_.get(value).scores.data() + begin,
+                scores_shift_.data() + begin);
 
         } else {
             float beta = (value == OTHER())
@@ -538,8 +617,45 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
                 scores_accum.size(),
                 scores_accum.data(),
                 score,
-                scores_shift_.data());
+                scores_shift_.data() + begin);
+        }
+    }
+
+    // Dirty (value, groupid) pairs may repeat, and may refer to values
+    // whose entries have since been removed; the latter are skipped.
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) const {
+        DenseIdSet & dirty = _dirty_groupids();
+        if (DIST_LIKELY(dirty.empty())) {
+            return;
+        }
+        const float alpha = shared.alpha;
+        Scratch scratch;
+        float * __restrict__ temp =
+            scratch.floats(dirty_values_.size() + dirty.size()).data();
+        size_t size = 0;
+        targets_.clear();
+        for (const auto & pair : dirty_values_) {
+            const Value value = pair.first;
+            const size_t groupid = pair.second;
+            if (DIST_LIKELY(scores_.contains(value))) {
+                count_t count = groups[groupid].counts.get_count(value);
+                temp[size++] = alpha * shared.betas.get(value) + count;
+                targets_.push_back(&scores_.get(value).scores[groupid]);
+            }
+        }
+        for (size_t groupid : dirty) {
+            temp[size++] = alpha + groups[groupid].counts.get_total();
+            targets_.push_back(&scores_shift_[groupid]);
         }
+        vector_log(size, temp);
+        for (size_t i = 0; i < size; ++i) {
+            *targets_[i] = temp[i];
+        }
+        dirty_values_.clear();
+        dirty.clear();
     }
 
     void validate(const Shared & shared, size_t group_count) const {
@@ -568,13 +684,73 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
         }
     }
 
+    // Entries whose ref_count has dropped to zero are skipped,
+    // since they are about to be removed.
+    void _update_group_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value * values) {
+        const DenseIdSet & touched = _touched_groupids(size, groupids);
+        const float alpha = shared.alpha;
+        Scratch scratch;
+        float * __restrict__ temp =
+            scratch.floats(size + touched.size()).data();
+        size_t temp_size = 0;
+        targets_.clear();
+        for (size_t i = 0; i < size; ++i) {
+            const Value value = values[i];
+            const size_t groupid = groupids[i];
+            auto & entry = scores_.get(value);
+            if (DIST_LIKELY(entry.ref_count)) {
+                count_t count = groups[groupid].counts.get_count(value);
+                temp[temp_size++] = alpha * shared.betas.get(value) + count;
+                targets_.push_back(&entry.scores[groupid]);
+            }
+        }
+        for (size_t groupid : touched) {
+            temp[temp_size++] = alpha + groups[groupid].counts.get_total();
+            targets_.push_back(&scores_shift_[groupid]);
+        }
+        vector_log(temp_size, temp);
+        for (size_t i = 0; i < temp_size; ++i) {
+            *targets_[i] = temp[i];
+        }
+    }
+
+    void _push_dirty_values(
+            size_t size,
+            const size_t * groupids,
+            const Value * values) {
+        for (size_t i = 0; i < size; ++i) {
+            dirty_values_.push_back(std::make_pair(values[i], groupids[i]));
+        }
+    }
+
+    // Call this after packed_remove(groupid) leaves group_count groups.
+    void _remove_dirty_values(size_t groupid, size_t group_count) {
+        size_t pos = 0;
+        for (auto pair : dirty_values_) {
+            if (pair.second != groupid) {
+                if (pair.second == group_count) {
+                    pair.second = groupid;
+                }
+                dirty_values_[pos++] = pair;
+            }
+        }
+        dirty_values_.resize(pos);
+    }
+
     struct CountAndScores {
         uint32_t ref_count;
         VectorFloat scores;
         CountAndScores() : ref_count(0), scores() {}
     };
-    Sparse_<Value, CountAndScores> scores_;
-    VectorFloat scores_shift_;
+    mutable Sparse_<Value, CountAndScores> scores_;
+    mutable VectorFloat scores_shift_;
+    mutable std::vector<float *> targets_;
+    mutable std::vector<std::pair<Value, size_t>> dirty_values_;
 };
 };  // struct DirichletProcessDiscrete
 }   // namespace distributions
@@ -31,7 +31,9 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
+#include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
 #include <distributions/mixture.hpp>
 
@@ -173,20 +175,28 @@ struct Group : GroupMixin<Model> {
 };
 
 struct Sampler {
-    float mean;
+    PoissonSampler poisson;
 
     void init(
             const Shared & shared,
             const Group & group,
             rng_t & rng) {
         Shared post = shared.plus_group(group);
-        mean = sample_gamma(rng, post.alpha, 1.f / post.inv_beta);
+        poisson.init(sample_gamma(rng, post.alpha, 1.f / post.inv_beta));
     }
 
     Value eval(
             const Shared &,
             rng_t & rng) const {
-        return sample_poisson(rng, mean);
+        return poisson.eval(rng);
+    }
+
+    void eval(
+            const Shared &,
+            size_t size,
+            Value * values,
+            rng_t & rng) const {
+        poisson.fill(rng, size, values);
     }
 };
 
@@ -219,44 +229,110 @@ struct Scorer {
 
 struct MixtureDataScorer
     : MixtureSlaveDataScorerMixin<Model, MixtureDataScorer> {
+    void resize(const Shared &, size_t size) {
+        count_.resize(size);
+        sum_.resize(size);
+        log_prod_.resize(size);
+    }
+
+    void add_group(const Shared &) {
+        count_.packed_add(0);
+        sum_.packed_add(0);
+        log_prod_.packed_add(0);
+    }
+
+    void remove_group(const Shared &, size_t groupid) {
+        count_.packed_remove(groupid);
+        sum_.packed_remove(groupid);
+        log_prod_.packed_remove(groupid);
+    }
+
+    void update_group(
+            const Shared &,
+            size_t groupid,
+            const Group & group) {
+        count_[groupid] = group.count;
+        sum_[groupid] = group.sum;
+        log_prod_[groupid] = group.log_prod;
+    }
+
     float score_data(
             const Shared & shared,
             const std::vector<Group> & groups,
-            rng_t &) const {
+            rng_t & rng) const {
+        if (DIST_UNLIKELY(count_.size() != groups.size())) {
+            return score_groups(shared, groups, rng);
+        }
         const float alpha_part = fast_lgamma(shared.alpha);
         const float beta_part = shared.alpha * fast_log(shared.inv_beta);
 
+        const size_t size = count_.size();
+        Scratch scratch;
+        float * __restrict__ post_alpha = scratch.floats(size).data();
+        float * __restrict__ lgamma_alpha = scratch.floats(size).data();
+        float * __restrict__ log_inv_beta = scratch.floats(size).data();
+        const float * __restrict__ count = VectorFloat_data(count_);
+        const float * __restrict__ sum = VectorFloat_data(sum_);
+        const float * __restrict__ log_prod = VectorFloat_data(log_prod_);
+        for (size_t i = 0; i < size; ++i) {
+            post_alpha[i] = shared.alpha + sum[i];
+            log_inv_beta[i] = shared.inv_beta + count[i];
+        }
+        vector_lgamma(size, post_alpha, lgamma_alpha);
+        vector_log(size, log_inv_beta);
+
         float score = 0;
-        for (auto const & group : groups) {
-            if (group.count) {
-                Shared post = shared.plus_group(group);
-                score += fast_lgamma(post.alpha) - alpha_part;
-                score += beta_part - post.alpha * fast_log(post.inv_beta);
-                score += -group.log_prod;
-            }
+        for (size_t i = 0; i < size; ++i) {
+            float group_score = lgamma_alpha[i] - alpha_part
+                              + beta_part - post_alpha[i] * log_inv_beta[i]
+                              - log_prod[i];
+            score += count[i] ? group_score : 0.f;
         }
 
         return score;
     }
+
+    void validate(
+            const Shared &,
+            const std::vector<Group> & groups) const {
+        const size_t size = groups.size();
+        DIST_ASSERT_EQ(count_.size(), size);
+        DIST_ASSERT_EQ(sum_.size(), size);
+        DIST_ASSERT_EQ(log_prod_.size(), size);
+        for (size_t i = 0; i < size; ++i) {
+            DIST_ASSERT_EQ(count_[i], groups[i].count);
+            DIST_ASSERT_EQ(sum_[i], groups[i].sum);
+            DIST_ASSERT_EQ(log_prod_[i], groups[i].log_prod);
+        }
+    }
+
+ private:
+    VectorFloat count_;
+    VectorFloat sum_;
+    VectorFloat log_prod_;
 };
 
 struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     void resize(const Shared &, size_t size) {
         score_.resize(size);
+        zero_score_.resize(size);
         post_alpha_.resize(size);
         score_coeff_.resize(size);
     }
 
     void add_group(const Shared &, rng_t &) {
         score_.packed_add();
+        zero_score_.packed_add();
         post_alpha_.packed_add();
         score_coeff_.packed_add();
     }
 
     void remove_group(const Shared &, size_t groupid) {
         score_.packed_remove(groupid);
+        zero_score_.packed_remove(groupid);
         post_alpha_.packed_remove(groupid);
         score_coeff_.packed_remove(groupid);
+        _remove_dirty_group(groupid, score_.size());
     }
 
     void update_group(
@@ -264,12 +340,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             size_t groupid,
             const Group & group,
             rng_t & rng) {
-        Model::Scorer base;
-        base.init(shared, group, rng);
-
-        score_[groupid] = base.score;
-        post_alpha_[groupid] = base.post_alpha;
-        score_coeff_[groupid] = base.score_coeff;
+        _update_group(shared, groupid, group, rng);
     }
 
     void add_value(
@@ -278,7 +349,9 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
     void remove_value(
@@ -287,25 +360,78 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
-    void update_all(
+    void add_values(
             const Shared & shared,
             const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
             rng_t & rng) {
-        const size_t group_count = groups.size();
-        for (size_t groupid = 0; groupid < group_count; ++groupid) {
-            update_group(shared, groupid, groups[groupid], rng);
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void remove_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t & rng) {
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void update_all(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) {
+        _dirty_groupids().clear();
+        const size_t size = groups.size();
+        Scratch scratch;
+        float * __restrict__ log_inv_beta = scratch.floats(size).data();
+        float * __restrict__ score = VectorFloat_data(score_);
+        float * __restrict__ zero_score = VectorFloat_data(zero_score_);
+        float * __restrict__ post_alpha = VectorFloat_data(post_alpha_);
+        float * __restrict__ score_coeff = VectorFloat_data(score_coeff_);
+        for (size_t i = 0; i < size; ++i) {
+            const Group & group = groups[i];
+            post_alpha[i] = shared.alpha + group.sum;
+            log_inv_beta[i] = shared.inv_beta + group.count;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            score_coeff[i] = 1.f + log_inv_beta[i];
+        }
+        vector_log(size, score_coeff);
+        vector_log(size, log_inv_beta);
+        vector_lgamma(size, post_alpha, score);
+        for (size_t i = 0; i < size; ++i) {
+            score_coeff[i] = -score_coeff[i];
+            zero_score[i] =
+                post_alpha[i] * (log_inv_beta[i] + score_coeff[i]);
+            score[i] = zero_score[i] - score[i];
         }
     }
 
     float score_value_group(
-            const Shared &,
-            const std::vector<Group> &,
+            const Shared & shared,
+            const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
+        flush(shared, groups, rng);
         return score_[groupid]
             + fast_lgamma(post_alpha_[groupid] + value)
             - fast_log_factorial(value)
@@ -313,24 +439,71 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     }
 
     void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
             const Shared & shared,
             const std::vector<Group> &,
             const Value & value,
+            size_t begin,
             AlignedFloats scores_accum,
             rng_t &) const;
 
+    // Values below this are scored relative to zero_score_, the score of
+    // value 0, folding the log(v!) term into the rising factorial:
+    //   lgamma(a + v) - lgamma(a) - log(v!)
+    //     = sum_{i < v} log((a + i) / (i + 1)),
+    // where a = post_alpha_.
+    static const Value small_value_limit = 9;
+
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) const {
+        DenseIdSet & dirty = _dirty_groupids();
+        if (DIST_UNLIKELY(not dirty.empty())) {
+            for (size_t groupid : dirty) {
+                _update_group(shared, groupid, groups[groupid], rng);
+            }
+            dirty.clear();
+        }
+    }
+
     void validate(
             const Shared &,
             const std::vector<Group> & groups) const {
         DIST_ASSERT_EQ(score_.size(), groups.size());
+        DIST_ASSERT_EQ(zero_score_.size(), groups.size());
         DIST_ASSERT_EQ(post_alpha_.size(), groups.size());
         DIST_ASSERT_EQ(score_coeff_.size(), groups.size());
     }
 
  private:
-    VectorFloat score_;
-    VectorFloat post_alpha_;
-    VectorFloat score_coeff_;
+    void _update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) const {
+        Model::Scorer base;
+        base.init(shared, group, rng);
+
+        score_[groupid] = base.score;
+        zero_score_[groupid] = base.score + fast_lgamma(base.post_alpha);
+        post_alpha_[groupid] = base.post_alpha;
+        score_coeff_[groupid] = base.score_coeff;
+    }
+
+    mutable VectorFloat score_;
+    mutable VectorFloat zero_score_;
+    mutable VectorFloat post_alpha_;
+    mutable VectorFloat score_coeff_;
 };
 };  // struct GammaPoisson
 }   // namespace distributions
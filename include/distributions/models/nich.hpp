@@ -31,7 +31,9 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
+#include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
 #include <distributions/mixture.hpp>
 
@@ -261,30 +263,103 @@ struct Scorer {
 
 struct MixtureDataScorer
     : MixtureSlaveDataScorerMixin<Model, MixtureDataScorer> {
+    void resize(const Shared &, size_t size) {
+        count_.resize(size);
+        mean_.resize(size);
+        count_times_variance_.resize(size);
+    }
+
+    void add_group(const Shared &) {
+        count_.packed_add(0);
+        mean_.packed_add(0);
+        count_times_variance_.packed_add(0);
+    }
+
+    void remove_group(const Shared &, size_t groupid) {
+        count_.packed_remove(groupid);
+        mean_.packed_remove(groupid);
+        count_times_variance_.packed_remove(groupid);
+    }
+
+    void update_group(
+            const Shared &,
+            size_t groupid,
+            const Group & group) {
+        count_[groupid] = group.count;
+        mean_[groupid] = group.mean;
+        count_times_variance_[groupid] = group.count_times_variance;
+    }
+
     float score_data(
             const Shared & shared,
             const std::vector<Group> & groups,
-            rng_t &) const {
+            rng_t & rng) const {
+        if (DIST_UNLIKELY(count_.size() != groups.size())) {
+            return score_groups(shared, groups, rng);
+        }
         const float nu_part = fast_lgamma(0.5f * shared.nu);
         const float kappa_part = 0.5f * fast_log(shared.kappa);
         const float sigmasq_part =
             0.5f * shared.nu * fast_log(shared.nu * shared.sigmasq);
         const float log_pi = 1.1447298858493991f;
 
+        const size_t size = count_.size();
+        Scratch scratch;
+        float * __restrict__ half_nu = scratch.floats(size).data();
+        float * __restrict__ kappa = scratch.floats(size).data();
+        float * __restrict__ nu_sigmasq = scratch.floats(size).data();
+        const float * __restrict__ count = VectorFloat_data(count_);
+        const float * __restrict__ mean = VectorFloat_data(mean_);
+        const float * __restrict__ count_times_variance =
+            VectorFloat_data(count_times_variance_);
+        for (size_t i = 0; i < size; ++i) {
+            float mu_1 = shared.mu - mean[i];
+            float post_kappa = shared.kappa + count[i];
+            half_nu[i] = 0.5f * (shared.nu + count[i]);
+            kappa[i] = post_kappa;
+            nu_sigmasq[i] = shared.nu * shared.sigmasq
+                          + count_times_variance[i]
+                          + (count[i] * shared.kappa * mu_1 * mu_1)
+                          / post_kappa;
+        }
+        vector_lgamma(size, half_nu);
+        vector_log(size, kappa);
+        vector_log(size, nu_sigmasq);
+
+        const float nu = shared.nu;
         float score = 0;
-        for (auto const & group : groups) {
-            if (group.count) {
-                Shared post = shared.plus_group(group);
-                score += fast_lgamma(0.5f * post.nu) - nu_part;
-                score += kappa_part - 0.5f * fast_log(post.kappa);
-                score += sigmasq_part
-                       - 0.5f * post.nu * fast_log(post.nu * post.sigmasq);
-                score += -0.5f * log_pi * group.count;
-            }
+        for (size_t i = 0; i < size; ++i) {
+            float group_score = half_nu[i] - nu_part
+                              + kappa_part - 0.5f * kappa[i]
+                              + sigmasq_part
+                              - 0.5f * (nu + count[i]) * nu_sigmasq[i]
+                              - 0.5f * log_pi * count[i];
+            score += count[i] ? group_score : 0.f;
         }
 
         return score;
     }
+
+    void validate(
+            const Shared &,
+            const std::vector<Group> & groups) const {
+        const size_t size = groups.size();
+        DIST_ASSERT_EQ(count_.size(), size);
+        DIST_ASSERT_EQ(mean_.size(), size);
+        DIST_ASSERT_EQ(count_times_variance_.size(), size);
+        for (size_t i = 0; i < size; ++i) {
+            DIST_ASSERT_EQ(count_[i], groups[i].count);
+            DIST_ASSERT_EQ(mean_[i], groups[i].mean);
+            DIST_ASSERT_EQ(
+                count_times_variance_[i],
+                groups[i].count_times_variance);
+        }
+    }
+
+ private:
+    VectorFloat count_;
+    VectorFloat mean_;
+    VectorFloat count_times_variance_;
 };
 
 struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
@@ -307,6 +382,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
         log_coeff_.packed_remove(groupid);
         precision_.packed_remove(groupid);
         mean_.packed_remove(groupid);
+        _remove_dirty_group(groupid, score_.size());
     }
 
     void update_group(
@@ -314,13 +390,7 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             size_t groupid,
             const Group & group,
             rng_t & rng) {
-        Model::Scorer base;
-        base.init(shared, group, rng);
-
-        score_[groupid] = base.score;
-        log_coeff_[groupid] = base.log_coeff;
-        precision_[groupid] = base.precision;
-        mean_[groupid] = base.mean;
+        _update_group(shared, groupid, group, rng);
     }
 
     void add_value(
@@ -329,7 +399,9 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
     void remove_value(
@@ -338,36 +410,130 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
             const Group & group,
             const Value &,
             rng_t & rng) {
-        update_group(shared, groupid, group, rng);
+        if (not _mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
     }
 
-    void update_all(
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t & rng) {
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void remove_values(
             const Shared & shared,
             const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
             rng_t & rng) {
-        const size_t group_count = groups.size();
-        for (size_t groupid = 0; groupid < group_count; ++groupid) {
-            update_group(shared, groupid, groups[groupid], rng);
+        if (not _mark_dirty(size, groupids)) {
+            for (size_t groupid : _touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void update_all(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) {
+        _dirty_groupids().clear();
+        const size_t size = groups.size();
+        Scratch scratch;
+        float * __restrict__ count = scratch.floats(size).data();
+        float * __restrict__ group_mean = scratch.floats(size).data();
+        float * __restrict__ count_times_variance =
+            scratch.floats(size).data();
+        float * __restrict__ temp = scratch.floats(size).data();
+        for (size_t i = 0; i < size; ++i) {
+            const Group & group = groups[i];
+            count[i] = group.count;
+            group_mean[i] = group.mean;
+            count_times_variance[i] = group.count_times_variance;
+        }
+
+        const float mu = shared.mu;
+        const float kappa = shared.kappa;
+        const float nu = shared.nu;
+        const float nu_sigmasq = shared.nu * shared.sigmasq;
+        float * __restrict__ score = VectorFloat_data(score_);
+        float * __restrict__ log_coeff = VectorFloat_data(log_coeff_);
+        float * __restrict__ precision = VectorFloat_data(precision_);
+        float * __restrict__ mean = VectorFloat_data(mean_);
+        for (size_t i = 0; i < size; ++i) {
+            float mu_1 = mu - group_mean[i];
+            float post_kappa = kappa + count[i];
+            float post_nu = nu + count[i];
+            float post_sigmasq = (
+                nu_sigmasq
+                + count_times_variance[i]
+                + (count[i] * kappa * mu_1 * mu_1) / post_kappa) / post_nu;
+            float lambda = post_kappa / ((post_kappa + 1.f) * post_sigmasq);
+            score[i] = post_nu;
+            temp[i] = lambda / (M_PIf * post_nu);
+            log_coeff[i] = -0.5f * post_nu - 0.5f;
+            precision[i] = lambda / post_nu;
+            mean[i] = (kappa * mu + group_mean[i] * count[i]) / post_kappa;
+        }
+        vector_lgamma_nu(size, score);
+        vector_log(size, temp);
+        for (size_t i = 0; i < size; ++i) {
+            score[i] += 0.5f * temp[i];
         }
     }
 
     float score_value_group(
-            const Shared &,
-            const std::vector<Group> &,
+            const Shared & shared,
+            const std::vector<Group> & groups,
             size_t groupid,
             const Value & value,
-            rng_t &) const {
+            rng_t & rng) const {
+        flush(shared, groups, rng);
         float temp = 1.f + precision_[groupid] * sqr(value - mean_[groupid]);
         return score_[groupid] + log_coeff_[groupid] * fast_log(temp);
     }
 
     void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
             const Shared &,
             const std::vector<Group> &,
             const Value & value,
+            size_t begin,
             AlignedFloats scores_accum,
             rng_t &) const;
 
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) const {
+        DenseIdSet & dirty = _dirty_groupids();
+        if (DIST_UNLIKELY(not dirty.empty())) {
+            for (size_t groupid : dirty) {
+                _update_group(shared, groupid, groups[groupid], rng);
+            }
+            dirty.clear();
+        }
+    }
+
     void validate(
             const Shared &,
             const std::vector<Group> & groups) const {
@@ -378,10 +544,24 @@ struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
     }
 
  private:
-    VectorFloat score_;
-    VectorFloat log_coeff_;
-    VectorFloat precision_;
-    VectorFloat mean_;
+    void _update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) const {
+        Model::Scorer base;
+        base.init(shared, group, rng);
+
+        score_[groupid] = base.score;
+        log_coeff_[groupid] = base.log_coeff;
+        precision_[groupid] = base.precision;
+        mean_[groupid] = base.mean;
+    }
+
+    mutable VectorFloat score_;
+    mutable VectorFloat log_coeff_;
+    mutable VectorFloat precision_;
+    mutable VectorFloat mean_;
 };
 };  // struct NormalInverseChiSq
 }   // namespace distributions
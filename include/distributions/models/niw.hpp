@@ -30,6 +30,7 @@
 #include <distributions/common.hpp>
 #include <distributions/special.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector.hpp>
 #include <distributions/vector_math.hpp>
 #include <distributions/mixins.hpp>
@@ -72,6 +73,11 @@ typedef Vector Value;
 struct Group;
 struct Scorer;
 struct Sampler;
+struct MixtureDataScorer;
+struct MixtureValueScorer;
+typedef MixtureSlave<Model, MixtureDataScorer> SmallMixture;
+typedef MixtureSlave<Model, MixtureDataScorer, MixtureValueScorer> FastMixture;
+typedef FastMixture Mixture;
 
 struct Shared : SharedMixin<Model> {
     Vector mu;
@@ -189,6 +195,116 @@ struct Group : GroupMixin<Model> {
     Vector sum_x;
     Matrix sum_xxT;
 
+    // The posterior mu, kappa and Cholesky factor of psi, kept current by
+    // rank-one updates on add and downdates on remove.  The cache is keyed
+    // on the prior it was built from, so any edit to a Shared is honoured;
+    // code writing the fields above directly must call touch(), after
+    // which the next non-const update rebuilds it in O(d^3).
+    // Only non-const methods write the cache; const readers go through
+    // peek_posterior, so a group may be scored from many threads.
+    struct Posterior {
+        bool valid;
+        int update_count;
+        float prior_kappa;
+        Vector prior_mu;
+        Matrix prior_psi;
+        int count;
+
+        Vector mu;
+        float kappa;
+        Eigen::LLT<Matrix> psi_llt;
+        float psi_log_det;
+        float prior_psi_log_det;
+
+        // psi_llt starts as the (empty if dynamic) identity's factor,
+        // so that its status is defined even before the first build.
+        Posterior() :
+            valid(false),
+            update_count(0),
+            prior_kappa(0),
+            count(0),
+            kappa(0),
+            psi_llt(Matrix::Identity(
+                dim_ == -1 ? 0 : dim_,
+                dim_ == -1 ? 0 : dim_)),
+            psi_log_det(0),
+            prior_psi_log_det(0) {}
+
+        // Downdates in float lose accuracy, so rebuild now and then.
+        static const int refresh_period = 64;
+
+        // Comparing the whole prior costs O(d^2), no more than a rank-one
+        // update or a single score.
+        bool matches(const Shared & shared, const Group & group) const {
+            return valid
+                and count == group.count
+                and prior_kappa == shared.kappa
+                and prior_mu == shared.mu
+                and prior_psi == shared.psi;
+        }
+
+        void build(const Shared & shared, const Group & group) {
+            const Shared post = shared.plus_group(group);
+            prior_kappa = shared.kappa;
+            prior_mu = shared.mu;
+            prior_psi = shared.psi;
+            count = group.count;
+            mu = post.mu;
+            kappa = post.kappa;
+            psi_llt.compute(post.psi);
+            psi_log_det = _log_det();
+            prior_psi_log_det = fast_log(shared.psi.determinant());
+            update_count = 0;
+            valid = (psi_llt.info() == Eigen::Success);
+        }
+
+        // Adds weight copies of value; a negative weight removes them.
+        void update(const Value & value, int weight) {
+            const float new_kappa = kappa + weight;
+            const Vector diff = value - mu;
+            psi_llt.rankUpdate(diff, kappa * weight / new_kappa);
+            mu = (kappa * mu + static_cast<float>(weight) * value)
+               / new_kappa;
+            kappa = new_kappa;
+            count += weight;
+            psi_log_det = _log_det();
+            valid = (psi_llt.info() == Eigen::Success)
+                and ++update_count < refresh_period;
+        }
+
+        float _log_det() const {
+            float result = 0;
+            const auto & L = psi_llt.matrixLLT();
+            for (int i = 0, size = L.rows(); i < size; ++i) {
+                result += fast_log(L(i, i));
+            }
+            return 2.f * result;
+        }
+    };
+
+    Posterior posterior;
+
+    void touch() { posterior.valid = false; }
+
+    const Posterior & get_posterior(const Shared & shared) {
+        if (DIST_UNLIKELY(not posterior.matches(shared, *this))) {
+            posterior.build(shared, *this);
+        }
+        return posterior;
+    }
+
+    // Like get_posterior but never writes the cache, building into temp
+    // on a miss.  All const methods read the posterior this way.
+    const Posterior & peek_posterior(
+            const Shared & shared,
+            Posterior & temp) const {
+        if (DIST_LIKELY(posterior.matches(shared, *this))) {
+            return posterior;
+        }
+        temp.build(shared, *this);
+        return temp;
+    }
+
     template<class Message>
     void protobuf_load(const Message & message) {
         // count
@@ -213,6 +329,7 @@ struct Group : GroupMixin<Model> {
         // XXX(stephentu): should also assert positive semi-definite
         DIST_ASSERT3(is_symmetric(sum_xxT), "expected sym matrix");
         DIST_ASSERT_EQ(sum_x.rows(), sum_xxT.rows());
+        touch();
     }
 
     template<class Message>
@@ -242,6 +359,7 @@ struct Group : GroupMixin<Model> {
         sum_x.setZero();
         sum_xxT.resize(shared.dim(), shared.dim());
         sum_xxT.setZero();
+        posterior.build(shared, *this);
     }
 
     void add_value(
@@ -249,9 +367,11 @@ struct Group : GroupMixin<Model> {
             const Value & value,
             rng_t &) {
         DIST_ASSERT3(shared.dim() == (size_t)value.size(), "dim mismatch");
+        const bool cached = posterior.matches(shared, *this);
         count++;
         sum_x += value;
         sum_xxT += value * value.transpose();
+        _update_posterior(shared, cached, value, 1);
     }
 
     void add_repeated_value(
@@ -260,9 +380,11 @@ struct Group : GroupMixin<Model> {
             const int & count,
             rng_t &) {
         DIST_ASSERT3(shared.dim() == (size_t)value.size(), "dim mismatch");
+        const bool cached = posterior.matches(shared, *this);
         this->count += count;
         sum_x += count * value;
         sum_xxT += count * (value * value.transpose());
+        _update_posterior(shared, cached, value, count);
     }
 
     void remove_value(
@@ -270,18 +392,21 @@ struct Group : GroupMixin<Model> {
             const Value & value,
             rng_t &) {
         DIST_ASSERT3(shared.dim() == (size_t)value.size(), "dim mismatch");
+        const bool cached = posterior.matches(shared, *this);
         count--;
         sum_x -= value;
         sum_xxT -= value * value.transpose();
+        _update_posterior(shared, cached, value, -1);
     }
 
     void merge(
-            const Shared &,
+            const Shared & shared,
             const Group & source,
             rng_t &) {
         count += source.count;
         sum_x += source.sum_x;
         sum_xxT += source.sum_xxT;
+        posterior.build(shared, *this);
     }
 
     float score_value(
@@ -296,13 +421,15 @@ struct Group : GroupMixin<Model> {
     float score_data(
             const Shared & shared,
             rng_t &) const {
-        Shared post = shared.plus_group(*this);
+        Posterior temp;
+        const Posterior & post = peek_posterior(shared, temp);
+        const float post_nu = shared.nu + count;
         const float log_pi = 1.1447298858494002;
-        return lmultigamma(shared.dim(), post.nu * 0.5)
-            + shared.nu * 0.5 * fast_log(shared.psi.determinant())
+        return lmultigamma(shared.dim(), post_nu * 0.5)
+            + shared.nu * 0.5 * post.prior_psi_log_det
             - static_cast<float>(count * shared.dim()) * 0.5 * log_pi
             - lmultigamma(shared.dim(), shared.nu * 0.5)
-            - post.nu * 0.5 * fast_log(post.psi.determinant())
+            - post_nu * 0.5 * post.psi_log_det
             + static_cast<float>(shared.dim())
               * 0.5 * fast_log(shared.kappa / post.kappa);
     }
@@ -315,7 +442,31 @@ struct Group : GroupMixin<Model> {
         return sampler.eval(shared, rng);
     }
 
-    void validate(const Shared & shared) const { }
+    void validate(const Shared & shared) const {
+        if (posterior.matches(shared, *this)) {
+            const Shared post = shared.plus_group(*this);
+            DIST_ASSERT(
+                posterior.psi_llt.reconstructedMatrix().isApprox(
+                    post.psi, 1e-3f),
+                "stale posterior cache");
+        }
+    }
+
+ private:
+    // Applies a rank-one update if the cache was current before the
+    // change, and rebuilds it otherwise, e.g. after a refresh period.
+    void _update_posterior(
+            const Shared & shared,
+            bool cached,
+            const Value & value,
+            int weight) {
+        if (cached) {
+            posterior.update(value, weight);
+        }
+        if (not posterior.matches(shared, *this)) {
+            posterior.build(shared, *this);
+        }
+    }
 };
 
 struct Sampler {
@@ -326,9 +477,12 @@ struct Sampler {
             const Shared & shared,
             const Group & group,
             rng_t & rng) {
-        Shared post = shared.plus_group(group);
+        typename Group::Posterior temp;
+        const typename Group::Posterior & post =
+            group.peek_posterior(shared, temp);
+        const Matrix psi = post.psi_llt.reconstructedMatrix();
         auto p = sample_normal_inverse_wishart(
-                post.mu, post.kappa, post.psi, post.nu, rng);
+                post.mu, post.kappa, psi, shared.nu + group.count, rng);
         mu.swap(p.first);
         cov.swap(p.second);
     }
@@ -340,24 +494,339 @@ struct Sampler {
     }
 };
 
+// The predictive is a multivariate Student-t with scale matrix
+// sigma = scale * psi, scored through the group's cached Cholesky factor
+// of psi at O(d^2) per value.
 struct Scorer {
-    Shared post;
+    Vector mu;
+    Matrix psi_cholesky;
+    float score;
+    float dof;
+    float quad_coeff;
 
     void init(
             const Shared & shared,
             const Group & group,
             rng_t &) {
-        post = shared.plus_group(group);
+        typename Group::Posterior temp;
+        const typename Group::Posterior & post =
+            group.peek_posterior(shared, temp);
+        const float d = shared.dim();
+        const float nu = shared.nu + group.count;
+        const float log_pi = 1.1447298858494002;
+        dof = nu - d + 1.f;
+        const float scale = (post.kappa + 1.f) / (post.kappa * dof);
+        mu = post.mu;
+        psi_cholesky = post.psi_llt.matrixL();
+        score = fast_lgamma(0.5f * (dof + d)) - fast_lgamma(0.5f * dof)
+              - 0.5f * (d * fast_log(scale) + post.psi_log_det)
+              - 0.5f * d * (fast_log(dof) + log_pi);
+        quad_coeff = 1.f / (scale * dof);
     }
 
     float eval(
             const Shared & shared,
             const Value & value,
             rng_t &) const {
-        const float dof = post.nu - static_cast<float>(shared.dim()) + 1.;
-        const Matrix sigma = post.psi * (post.kappa + 1.) / (post.kappa * dof);
-        return score_mv_student_t(value, dof, post.mu, sigma);
+        const float d = shared.dim();
+        const Vector diff =
+            psi_cholesky.template triangularView<Eigen::Lower>().solve(
+                value - mu);
+        const float quad = quad_coeff * diff.squaredNorm();
+        return score - 0.5f * (dof + d) * fast_log(1.f + quad);
+    }
+};
+
+struct MixtureDataScorer
+    : MixtureSlaveDataScorerMixin<Model, MixtureDataScorer> {
+    float score_data(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t &) const {
+        const float dim = shared.dim();
+        const float log_pi = 1.1447298858494002;
+        const float shared_part =
+            shared.nu * 0.5f * fast_log(shared.psi.determinant())
+            - lmultigamma(shared.dim(), shared.nu * 0.5f)
+            + dim * 0.5f * fast_log(shared.kappa);
+
+        typename Group::Posterior temp;
+        float score = 0;
+        for (auto const & group : groups) {
+            if (group.count) {
+                const auto & post = group.peek_posterior(shared, temp);
+                const float post_nu = shared.nu + group.count;
+                score += shared_part
+                    + lmultigamma(shared.dim(), post_nu * 0.5f)
+                    - post_nu * 0.5f * post.psi_log_det
+                    - dim * 0.5f * fast_log(post.kappa)
+                    - group.count * dim * 0.5f * log_pi;
+            }
+        }
+        return score;
+    }
+};
+
+// Each group's Scorer is stored column-wise: one column per component of
+// the mean and per entry of the lower Cholesky factor, with the diagonal
+// inverted.  score_value then runs forward substitution for all groups
+// in lockstep, each step a flat loop over groups.
+struct MixtureValueScorer : MixtureSlaveValueScorerMixin<Model> {
+    void resize(const Shared & shared, size_t size) {
+        const size_t dim = shared.dim();
+        mean_.resize(dim);
+        factor_.resize(dim * (dim + 1) / 2);
+        for (auto & column : mean_) {
+            column.resize(size);
+        }
+        for (auto & column : factor_) {
+            column.resize(size);
+        }
+        score_.resize(size);
+        quad_coeff_.resize(size);
+        log_coeff_.resize(size);
+    }
+
+    void add_group(const Shared &, rng_t &) {
+        for (auto & column : mean_) {
+            column.packed_add();
+        }
+        for (auto & column : factor_) {
+            column.packed_add();
+        }
+        score_.packed_add();
+        quad_coeff_.packed_add();
+        log_coeff_.packed_add();
+    }
+
+    void remove_group(const Shared &, size_t groupid) {
+        for (auto & column : mean_) {
+            column.packed_remove(groupid);
+        }
+        for (auto & column : factor_) {
+            column.packed_remove(groupid);
+        }
+        score_.packed_remove(groupid);
+        quad_coeff_.packed_remove(groupid);
+        log_coeff_.packed_remove(groupid);
+        this->_remove_dirty_group(groupid, score_.size());
+    }
+
+    void update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) {
+        _update_group(shared, groupid, group, rng);
+    }
+
+    void add_value(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            const Value &,
+            rng_t & rng) {
+        if (not this->_mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
+    }
+
+    void remove_value(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            const Value &,
+            rng_t & rng) {
+        if (not this->_mark_dirty(groupid)) {
+            update_group(shared, groupid, group, rng);
+        }
+    }
+
+    void add_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t & rng) {
+        if (not this->_mark_dirty(size, groupids)) {
+            for (size_t groupid : this->_touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void remove_values(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t size,
+            const size_t * groupids,
+            const Value *,
+            rng_t & rng) {
+        if (not this->_mark_dirty(size, groupids)) {
+            for (size_t groupid : this->_touched_groupids(size, groupids)) {
+                update_group(shared, groupid, groups[groupid], rng);
+            }
+        }
+    }
+
+    void update_all(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) {
+        this->_dirty_groupids().clear();
+        const size_t group_count = groups.size();
+        for (size_t groupid = 0; groupid < group_count; ++groupid) {
+            update_group(shared, groupid, groups[groupid], rng);
+        }
+    }
+
+    float score_value_group(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        const size_t dim = mean_.size();
+        Scratch scratch;
+        float * __restrict__ diff = scratch.floats(dim).data();
+        float quad = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            float y = value(i) - mean_[i][groupid];
+            for (size_t j = 0; j < i; ++j) {
+                y -= factor_[_tri(i, j)][groupid] * diff[j];
+            }
+            y *= factor_[_tri(i, i)][groupid];
+            diff[i] = y;
+            quad += y * y;
+        }
+        return score_[groupid] + log_coeff_[groupid]
+            * fast_log(1.f + quad_coeff_[groupid] * quad);
+    }
+
+    void score_value(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        flush(shared, groups, rng);
+        score_value_range(shared, groups, value, 0, scores_accum, rng);
+    }
+
+    void score_value_range(
+            const Shared &,
+            const std::vector<Group> &,
+            const Value & value,
+            size_t begin,
+            AlignedFloats scores_accum,
+            rng_t &) const {
+        const size_t size = scores_accum.size();
+        const size_t dim = mean_.size();
+        Scratch scratch;
+        float * __restrict__ diffs = scratch.floats(dim * size).data();
+        float * __restrict__ quad = scratch.floats(size).data();
+        vector_zero(size, quad);
+        for (size_t i = 0; i < dim; ++i) {
+            float * __restrict__ diff = diffs + i * size;
+            const float x = value(i);
+            const float * __restrict__ mean =
+                VectorFloat_data(mean_[i]) + begin;
+            for (size_t k = 0; k < size; ++k) {
+                diff[k] = x - mean[k];
+            }
+            for (size_t j = 0; j < i; ++j) {
+                const float * __restrict__ factor =
+                    VectorFloat_data(factor_[_tri(i, j)]) + begin;
+                const float * __restrict__ prev = diffs + j * size;
+                for (size_t k = 0; k < size; ++k) {
+                    diff[k] -= factor[k] * prev[k];
+                }
+            }
+            const float * __restrict__ inv_diag =
+                VectorFloat_data(factor_[_tri(i, i)]) + begin;
+            for (size_t k = 0; k < size; ++k) {
+                diff[k] *= inv_diag[k];
+                quad[k] += diff[k] * diff[k];
+            }
+        }
+
+        const float * __restrict__ quad_coeff =
+            VectorFloat_data(quad_coeff_) + begin;
+        for (size_t k = 0; k < size; ++k) {
+            quad[k] = 1.f + quad_coeff[k] * quad[k];
+        }
+        vector_log(size, quad);
+        const float * __restrict__ score = VectorFloat_data(score_) + begin;
+        const float * __restrict__ log_coeff =
+            VectorFloat_data(log_coeff_) + begin;
+        float * __restrict__ scores_accum_noalias =
+            VectorFloat_data(scores_accum);
+        for (size_t k = 0; k < size; ++k) {
+            scores_accum_noalias[k] += score[k] + log_coeff[k] * quad[k];
+        }
     }
+
+    void flush(
+            const Shared & shared,
+            const std::vector<Group> & groups,
+            rng_t & rng) const {
+        DenseIdSet & dirty = this->_dirty_groupids();
+        if (DIST_UNLIKELY(not dirty.empty())) {
+            for (size_t groupid : dirty) {
+                _update_group(shared, groupid, groups[groupid], rng);
+            }
+            dirty.clear();
+        }
+    }
+
+    void validate(
+            const Shared & shared,
+            const std::vector<Group> & groups) const {
+        const size_t dim = shared.dim();
+        DIST_ASSERT_EQ(mean_.size(), dim);
+        DIST_ASSERT_EQ(factor_.size(), dim * (dim + 1) / 2);
+        for (const auto & column : mean_) {
+            DIST_ASSERT_EQ(column.size(), groups.size());
+        }
+        for (const auto & column : factor_) {
+            DIST_ASSERT_EQ(column.size(), groups.size());
+        }
+        DIST_ASSERT_EQ(score_.size(), groups.size());
+        DIST_ASSERT_EQ(quad_coeff_.size(), groups.size());
+        DIST_ASSERT_EQ(log_coeff_.size(), groups.size());
+    }
+
+ private:
+    static size_t _tri(size_t i, size_t j) { return i * (i + 1) / 2 + j; }
+
+    void _update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) const {
+        Scorer base;
+        base.init(shared, group, rng);
+
+        const size_t dim = mean_.size();
+        for (size_t i = 0; i < dim; ++i) {
+            mean_[i][groupid] = base.mu(i);
+            for (size_t j = 0; j < i; ++j) {
+                factor_[_tri(i, j)][groupid] = base.psi_cholesky(i, j);
+            }
+            factor_[_tri(i, i)][groupid] = 1.f / base.psi_cholesky(i, i);
+        }
+        score_[groupid] = base.score;
+        quad_coeff_[groupid] = base.quad_coeff;
+        log_coeff_[groupid] = -0.5f * (base.dof + dim);
+    }
+
+    mutable std::vector<VectorFloat> mean_;
+    mutable std::vector<VectorFloat> factor_;
+    mutable VectorFloat score_;
+    mutable VectorFloat quad_coeff_;
+    mutable VectorFloat log_coeff_;
 };
 };  // struct NormalInverseWishart
 
@@ -0,0 +1,102 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+#include <distributions/common.hpp>
+#include <distributions/random_fwd.hpp>
+#include <distributions/vector.hpp>
+#include <distributions/vector_math.hpp>
+#include <distributions/thread_pool.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Parallel Group Sampler
+//
+// This samples a groupid from scores over a very large number of groups,
+// e.g. 10^5 or more.  The group axis is split into cache-aligned chunks.
+// Each task zeros and scores its chunk, then converts the chunk in place
+// to likelihoods relative to the chunk's max score, recording the chunk
+// max and sum.  Sampling then needs only a reduction over chunks and a
+// scan of one chunk.  Small group counts are scored in a single chunk on
+// the calling thread.
+
+class ParallelGroupSampler {
+ public:
+    explicit ParallelGroupSampler(
+            ThreadPool & pool,
+            size_t min_chunk_size = 4096);
+
+    // score_range(begin, chunk, rng) should accumulate the scores of
+    // groups [begin, begin + chunk.size()) into the zeroed chunk, e.g. by
+    // calling score_value_range on each feature's MixtureSlave; lazy
+    // slaves must be flushed beforehand.  Each chunk gets its own rng.
+    // On return, scores holds chunk-relative likelihoods.
+    template<class ScoreRange>
+    size_t sample(
+            rng_t & rng,
+            size_t group_count,
+            VectorFloat & scores,
+            const ScoreRange & score_range) {
+        DIST_ASSERT1(group_count, "cannot sample from zero groups");
+        _plan(rng, group_count);
+        scores.resize(group_count);
+        float * data = scores.data();
+        pool_.parallel_for(chunks_.size(), [&](size_t c) {
+            Chunk & chunk = chunks_[c];
+            AlignedFloats part(data + chunk.begin, chunk.end - chunk.begin);
+            vector_zero(part.size(), part.data());
+            score_range(chunk.begin, part, rngs_[c]);
+            _to_likelihoods(chunk, part);
+        });
+        return _sample(rng, scores);
+    }
+
+    size_t chunk_count() const { return chunks_.size(); }
+
+ private:
+    struct Chunk {
+        size_t begin;
+        size_t end;
+        float max_score;
+        float total;
+    };
+
+    void _plan(rng_t & rng, size_t group_count);
+    static void _to_likelihoods(Chunk & chunk, AlignedFloats scores);
+    size_t _sample(rng_t & rng, const VectorFloat & likelihoods) const;
+
+    ThreadPool & pool_;
+    const size_t min_chunk_size_;
+    size_t group_count_;
+    std::vector<Chunk> chunks_;
+    std::vector<rng_t> rngs_;
+};
+
+}   // namespace distributions
@@ -0,0 +1,726 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <distributions/common.hpp>
+#include <distributions/random.hpp>
+#include <distributions/vector.hpp>
+#include <distributions/clustering.hpp>
+#include <distributions/mixture.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Static Indices
+//
+// Indices<0, ..., n-1> is used to expand an operation over each element of
+// a tuple in order, without recursion or virtual dispatch.
+
+template<size_t... Is>
+struct Indices {};
+
+template<size_t n, size_t... Is>
+struct MakeIndices : MakeIndices<n - 1, n - 1, Is...> {};
+
+template<size_t... Is>
+struct MakeIndices<0, Is...> {
+    typedef Indices<Is...> type;
+};
+
+// Each expansion visits features in order; the leading 0 keeps the array
+// nonempty when there are no features.
+#define DIST_FOR_EACH_FEATURE(expr) \
+    { int PRIVATE_swallow[] = {0, ((expr), 0)...}; (void) PRIVATE_swallow; }
+
+// --------------------------------------------------------------------------
+// Value Column
+//
+// This is a reusable contiguous buffer of one feature's values, e.g. for
+// batched MixtureSlave::add_values.  Unlike std::vector<bool>, it is
+// contiguous for every value type.
+
+template<class Value>
+class ValueColumn {
+ public:
+    ValueColumn() : values_(), capacity_(0) {}
+
+    Value * data() { return values_.get(); }
+    const Value * data() const { return values_.get(); }
+
+    // Contents are not preserved.
+    void reserve(size_t size) {
+        if (DIST_UNLIKELY(size > capacity_)) {
+            values_.reset(new Value[size]);
+            capacity_ = size;
+        }
+    }
+
+ private:
+    std::unique_ptr<Value[]> values_;
+    size_t capacity_;
+};
+
+// --------------------------------------------------------------------------
+// Product Model
+//
+// This is a model of rows with one value per feature, where features are
+// independent given the group, so that row samplers such as GibbsSampler
+// run over several features at once.  A group is a tuple of feature
+// groups, and the mixture keeps one mixture per feature, each with its
+// own scorers; feature groups are not stored twice, so the mixture
+// reads a group through copy_group, merge_into and score_data_group
+// rather than groups(groupid).
+
+template<class... Models>
+struct ProductModel {
+typedef ProductModel<Models...> Model;
+typedef std::tuple<typename Models::Value...> Value;
+typedef typename MakeIndices<sizeof...(Models)>::type All;
+
+struct Shared : std::tuple<typename Models::Shared...> {
+    typedef std::tuple<typename Models::Shared...> Features;
+
+    static Shared EXAMPLE() {
+        Shared shared;
+        static_cast<Features &>(shared) =
+            Features(Models::Shared::EXAMPLE()...);
+        return shared;
+    }
+};
+
+struct Group {
+    std::tuple<typename Models::Group...> features;
+
+    void init(const Shared & shared, rng_t & rng) {
+        _init(All(), shared, rng);
+    }
+
+    void add_value(const Shared & shared, const Value & value, rng_t & rng) {
+        _add_value(All(), shared, value, rng);
+    }
+
+    void remove_value(
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) {
+        _remove_value(All(), shared, value, rng);
+    }
+
+    void merge(const Shared & shared, const Group & source, rng_t & rng) {
+        _merge(All(), shared, source, rng);
+    }
+
+    float score_value(
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) const {
+        float score = 0;
+        _score_value(All(), shared, value, score, rng);
+        return score;
+    }
+
+    float score_data(const Shared & shared, rng_t & rng) const {
+        float score = 0;
+        _score_data(All(), shared, score, rng);
+        return score;
+    }
+
+    Value sample_value(const Shared & shared, rng_t & rng) const {
+        Value value;
+        _sample_value(All(), shared, value, rng);
+        return value;
+    }
+
+    void validate(const Shared & shared) const {
+        _validate(All(), shared);
+    }
+
+ private:
+    template<size_t... Is>
+    void _init(Indices<Is...>, const Shared & shared, rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features).init(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _add_value(
+            Indices<Is...>,
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features).add_value(
+            std::get<Is>(shared),
+            std::get<Is>(value),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _remove_value(
+            Indices<Is...>,
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features).remove_value(
+            std::get<Is>(shared),
+            std::get<Is>(value),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _merge(
+            Indices<Is...>,
+            const Shared & shared,
+            const Group & source,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features).merge(
+            std::get<Is>(shared),
+            std::get<Is>(source.features),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _score_value(
+            Indices<Is...>,
+            const Shared & shared,
+            const Value & value,
+            float & score,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(score += std::get<Is>(features).score_value(
+            std::get<Is>(shared),
+            std::get<Is>(value),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _score_data(
+            Indices<Is...>,
+            const Shared & shared,
+            float & score,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(score += std::get<Is>(features).score_data(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _sample_value(
+            Indices<Is...>,
+            const Shared & shared,
+            Value & value,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(value) =
+            std::get<Is>(features).sample_value(std::get<Is>(shared), rng));
+    }
+
+    template<size_t... Is>
+    void _validate(Indices<Is...>, const Shared & shared) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features).validate(
+            std::get<Is>(shared)));
+    }
+};
+
+struct Mixture {
+    typedef std::tuple<typename Models::Mixture...> Features;
+
+    const Features & features() const { return features_; }
+
+    template<size_t i>
+    const typename std::tuple_element<i, Features>::type & feature() const {
+        return std::get<i>(features_);
+    }
+
+    // Group count, including empty groups
+    size_t size() const { return std::get<0>(features_).groups().size(); }
+
+    // Groups are stored per feature, so there is no groups(groupid);
+    // these visit a group's feature groups in place.
+    void copy_group(size_t groupid, Group & group) const {
+        _copy_group(All(), groupid, group);
+    }
+
+    void merge_into(
+            const Shared & shared,
+            size_t groupid,
+            Group & destin,
+            rng_t & rng) const {
+        _merge_into(All(), shared, groupid, destin, rng);
+    }
+
+    float score_data_group(
+            const Shared & shared,
+            size_t groupid,
+            rng_t & rng) const {
+        float score = 0;
+        _score_data_group(All(), shared, groupid, score, rng);
+        return score;
+    }
+
+    void init(const Shared & shared, rng_t & rng) {
+        _init(All(), shared, rng);
+    }
+
+    void set_lazy(bool lazy) { _set_lazy(All(), lazy); }
+
+    void add_group(const Shared & shared, rng_t & rng) {
+        _add_group(All(), shared, rng);
+    }
+
+    void remove_group(const Shared & shared, size_t groupid) {
+        _remove_group(All(), shared, groupid);
+    }
+
+    void add_value(
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) {
+        _add_value(All(), shared, groupid, value, rng);
+    }
+
+    void remove_value(
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) {
+        _remove_value(All(), shared, groupid, value, rng);
+    }
+
+    // Replaces a group's statistics in every feature, as in
+    // MixtureSlave::update_group.
+    void update_group(
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) {
+        _update_group(All(), shared, groupid, group, rng);
+    }
+
+    // Batched add_value, which splits rows into one column per feature.
+    void add_values(
+            const Shared & shared,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t & rng) {
+        _add_values(All(), shared, size, groupids, values, rng);
+    }
+
+    float score_value_group(
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const {
+        float score = 0;
+        _score_value_group(All(), shared, groupid, value, score, rng);
+        return score;
+    }
+
+    void score_value(
+            const Shared & shared,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        _score_value(All(), shared, value, scores_accum, rng);
+    }
+
+    void flush(const Shared & shared, rng_t & rng) const {
+        _flush(All(), shared, rng);
+    }
+
+    float score_data(const Shared & shared, rng_t & rng) const {
+        float score = 0;
+        _score_data(All(), shared, score, rng);
+        return score;
+    }
+
+    void validate(const Shared & shared) const {
+        _validate(All(), shared);
+    }
+
+ private:
+    template<size_t... Is>
+    void _copy_group(Indices<Is...>, size_t groupid, Group & group) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).copy_group(
+            groupid,
+            std::get<Is>(group.features)));
+    }
+
+    template<size_t... Is>
+    void _merge_into(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            Group & destin,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).merge_into(
+            std::get<Is>(shared),
+            groupid,
+            std::get<Is>(destin.features),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _score_data_group(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            float & score,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(
+            score += std::get<Is>(features_).score_data_group(
+                std::get<Is>(shared),
+                groupid,
+                rng));
+    }
+
+    template<size_t... Is>
+    void _init(Indices<Is...>, const Shared & shared, rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).init(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _set_lazy(Indices<Is...>, bool lazy) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).set_lazy(lazy));
+    }
+
+    template<size_t... Is>
+    void _add_group(Indices<Is...>, const Shared & shared, rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).add_group(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _remove_group(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).remove_group(
+            std::get<Is>(shared),
+            groupid));
+    }
+
+    template<size_t... Is>
+    void _add_value(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).add_value(
+            std::get<Is>(shared),
+            groupid,
+            std::get<Is>(value),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _remove_value(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).remove_value(
+            std::get<Is>(shared),
+            groupid,
+            std::get<Is>(value),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _update_group(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            const Group & group,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).update_group(
+            std::get<Is>(shared),
+            groupid,
+            std::get<Is>(group.features),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _add_values(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t & rng) {
+        DIST_FOR_EACH_FEATURE(_add_column<Is>(
+            std::get<Is>(shared),
+            size,
+            groupids,
+            values,
+            rng));
+    }
+
+    template<size_t i, class FeatureShared>
+    void _add_column(
+            const FeatureShared & shared,
+            size_t size,
+            const size_t * groupids,
+            const Value * values,
+            rng_t & rng) {
+        auto & column = std::get<i>(columns_);
+        column.reserve(size);
+        auto * data = column.data();
+        for (size_t j = 0; j < size; ++j) {
+            data[j] = std::get<i>(values[j]);
+        }
+        std::get<i>(features_).add_values(shared, size, groupids, data, rng);
+    }
+
+    template<size_t... Is>
+    void _score_value_group(
+            Indices<Is...>,
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            float & score,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(
+            score += std::get<Is>(features_).score_value_group(
+                std::get<Is>(shared),
+                groupid,
+                std::get<Is>(value),
+                rng));
+    }
+
+    template<size_t... Is>
+    void _score_value(
+            Indices<Is...>,
+            const Shared & shared,
+            const Value & value,
+            AlignedFloats scores_accum,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).score_value(
+            std::get<Is>(shared),
+            std::get<Is>(value),
+            scores_accum,
+            rng));
+    }
+
+    template<size_t... Is>
+    void _flush(Indices<Is...>, const Shared & shared, rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(std::get<Is>(features_).flush(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _score_data(
+            Indices<Is...>,
+            const Shared & shared,
+            float & score,
+            rng_t & rng) const {
+        DIST_FOR_EACH_FEATURE(score += std::get<Is>(features_).score_data(
+            std::get<Is>(shared),
+            rng));
+    }
+
+    template<size_t... Is>
+    void _validate(Indices<Is...>, const Shared & shared) const {
+        DIST_FOR_EACH_FEATURE(_validate_feature(
+            std::get<Is>(shared),
+            std::get<Is>(features_)));
+    }
+
+    template<class FeatureShared, class Feature>
+    void _validate_feature(
+            const FeatureShared & shared,
+            const Feature & feature) const {
+        DIST_ASSERT_EQ(feature.groups().size(), size());
+        feature.validate(shared);
+    }
+
+    Features features_;
+    std::tuple<ValueColumn<typename Models::Value>...> columns_;
+};
+};  // struct ProductModel
+
+#undef DIST_FOR_EACH_FEATURE
+
+// --------------------------------------------------------------------------
+// Product Mixture
+//
+// This owns one Pitman-Yor clustering, one ProductModel mixture, and a
+// MixtureIdTracker, and keeps them in sync as rows move between groups.
+// A row is a tuple with one value per feature.  All features score into a
+// single aligned buffer, and features are dispatched statically.
+// GibbsSampler<ProductModel<Models...>> runs sweeps, split-merge and
+// parallel sweeps over the same features.
+
+template<class count_t, class... Models>
+class ProductMixture {
+ public:
+    typedef ProductModel<Models...> Product;
+    typedef typename Clustering<count_t>::PitmanYor ClusteringModel;
+    typedef typename ClusteringModel::Mixture ClusteringMixture;
+    typedef typename Product::Shared Shareds;
+    typedef typename Product::Mixture::Features Features;
+    typedef typename Product::Value Row;
+
+    struct Model {
+        ClusteringModel clustering;
+        Shareds features;
+    };
+
+    static const size_t feature_count = sizeof...(Models);
+
+    void init(
+            const Model & model,
+            rng_t & rng,
+            size_t empty_group_count = 1) {
+        DIST_ASSERT(empty_group_count, "empty_group_count must be positive");
+        clustering_.counts().assign(empty_group_count, 0);
+        clustering_.init(model.clustering);
+        features_.init(model.features, rng);
+        for (size_t i = 0; i < empty_group_count; ++i) {
+            features_.add_group(model.features, rng);
+        }
+        id_tracker_.init(empty_group_count);
+    }
+
+    // Group count, including empty groups
+    size_t size() const { return clustering_.counts().size(); }
+
+    const ClusteringMixture & clustering() const { return clustering_; }
+    const Features & features() const { return features_.features(); }
+    const MixtureIdTracker & id_tracker() const { return id_tracker_; }
+
+    template<size_t i>
+    const typename std::tuple_element<i, Features>::type & feature() const {
+        return features_.template feature<i>();
+    }
+
+    void set_lazy(bool lazy) { features_.set_lazy(lazy); }
+
+    bool add_row(
+            const Model & model,
+            size_t groupid,
+            const Row & row,
+            rng_t & rng) {
+        const bool group_added =
+            clustering_.add_value(model.clustering, groupid);
+        features_.add_value(model.features, groupid, row, rng);
+        if (DIST_UNLIKELY(group_added)) {
+            features_.add_group(model.features, rng);
+            id_tracker_.add_group();
+        }
+        return group_added;
+    }
+
+    bool remove_row(
+            const Model & model,
+            size_t groupid,
+            const Row & row,
+            rng_t & rng) {
+        const bool group_removed =
+            clustering_.remove_value(model.clustering, groupid);
+        features_.remove_value(model.features, groupid, row, rng);
+        if (DIST_UNLIKELY(group_removed)) {
+            features_.remove_group(model.features, groupid);
+            id_tracker_.remove_group(groupid);
+        }
+        return group_removed;
+    }
+
+    // The returned scores are valid until the next call to score_row.
+    VectorFloat & score_row(
+            const Model & model,
+            const Row & row,
+            rng_t & rng) const {
+        scores_.resize(size());
+        clustering_.score_value(model.clustering, scores_);
+        features_.score_value(model.features, row, scores_, rng);
+        return scores_;
+    }
+
+    size_t sample_row(
+            const Model & model,
+            const Row & row,
+            rng_t & rng) const {
+        return sample_from_scores_overwrite(rng, score_row(model, row, rng));
+    }
+
+    // Streams in a batch of rows, writing each row's groupid, as in
+    // GibbsSampler::ingest: each row is assigned by one scoring pass,
+    // either sampled or, if map is set, to the most likely group, and is
+    // committed by add_row before the next row is scored, so each row sees
+    // every earlier row of the batch.
+    void ingest_rows(
+            const Model & model,
+            size_t size,
+            const Row * rows,
+            size_t * groupids,
+            rng_t & rng,
+            bool map = false) {
+        for (size_t i = 0; i < size; ++i) {
+            VectorFloat & scores = score_row(model, rows[i], rng);
+            size_t groupid;
+            if (map) {
+                groupid = std::max_element(scores.begin(), scores.end())
+                        - scores.begin();
+            } else {
+                groupid = sample_from_scores_overwrite(rng, scores);
+            }
+            groupids[i] = groupid;
+            add_row(model, groupid, rows[i], rng);
+        }
+    }
+
+    float score_data(const Model & model, rng_t & rng) const {
+        return clustering_.score_data(model.clustering)
+             + features_.score_data(model.features, rng);
+    }
+
+    void validate(const Model & model) const {
+        DIST_ASSERT_EQ(id_tracker_.packed_size(), size());
+        DIST_ASSERT_EQ(features_.size(), size());
+        features_.validate(model.features);
+    }
+
+ private:
+    ClusteringMixture clustering_;
+    typename Product::Mixture features_;
+    MixtureIdTracker id_tracker_;
+    mutable VectorFloat scores_;
+};
+
+}   // namespace distributions
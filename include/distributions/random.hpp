@@ -27,10 +27,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include <random>
 #include <distributions/common.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/special.hpp>
 #include <distributions/vector_math.hpp>
 #include <distributions/random_fwd.hpp>
@@ -74,14 +76,166 @@ inline float sample_chisq(rng_t & rng, float nu) {
     return sampler(rng);
 }
 
+// --------------------------------------------------------------------------
+// Poisson and Negative Binomial Samplers
+//
+// These samplers hold their setup state, so that repeated draws with fixed
+// parameters pay only the per-draw cost.  Large means use the PTRS
+// transformed rejection method \cite{hormann1993transformed};
+// small means use sequential inversion.
+
+struct PoissonSampler {
+    void init(float mean) {
+        DIST_ASSERT1(mean >= 0, "bad mean: " << mean);
+        mean_ = mean;
+        exp_neg_mean_ = log_mean_ = a_ = b_ = log_inv_alpha_ = v_r_ = 0;
+        if (mean_ < ptrs_min_mean()) {
+            exp_neg_mean_ = std::exp(-mean_);
+        } else {
+            const double sqrt_mean = std::sqrt(mean_);
+            log_mean_ = std::log(mean_);
+            b_ = 0.931 + 2.53 * sqrt_mean;
+            a_ = -0.059 + 0.02483 * b_;
+            log_inv_alpha_ = std::log(1.1239 + 1.1328 / (b_ - 3.4));
+            v_r_ = 0.9277 - 3.6224 / (b_ - 2);
+        }
+    }
+
+    int eval(rng_t & rng) const {
+        return DIST_LIKELY(mean_ < ptrs_min_mean())
+            ? _eval_inversion(rng)
+            : _eval_ptrs(rng);
+    }
+
+    template<class T>
+    void fill(rng_t & rng, size_t size, T * values) const {
+        if (mean_ < ptrs_min_mean()) {
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = _eval_inversion(rng);
+            }
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = _eval_ptrs(rng);
+            }
+        }
+    }
+
+    static constexpr double ptrs_min_mean() { return 10.0; }
+
+ private:
+    int _eval_inversion(rng_t & rng) const {
+        std::uniform_real_distribution<double> unif01(0.0, 1.0);
+        double u = unif01(rng);
+        double prob = exp_neg_mean_;
+        int k = 0;
+        while (u > prob and prob > 0) {
+            u -= prob;
+            k += 1;
+            prob *= mean_ / k;
+        }
+        return k;
+    }
+
+    int _eval_ptrs(rng_t & rng) const {
+        std::uniform_real_distribution<double> unif01(0.0, 1.0);
+        while (true) {
+            const double u = unif01(rng) - 0.5;
+            const double v = unif01(rng);
+            const double us = 0.5 - std::fabs(u);
+            const double k = std::floor((2 * a_ / us + b_) * u + mean_ + 0.43);
+            if (us >= 0.07 and v <= v_r_) {
+                return k;
+            }
+            if (k < 0 or (us < 0.013 and v > us)) {
+                continue;
+            }
+            const double lhs =
+                std::log(v) + log_inv_alpha_ - std::log(a_ / (us * us) + b_);
+            const double rhs = -mean_ + k * log_mean_ - std::lgamma(k + 1);
+            if (lhs <= rhs) {
+                return k;
+            }
+        }
+    }
+
+    double mean_;
+    double exp_neg_mean_;
+    double log_mean_;
+    double a_;
+    double b_;
+    double log_inv_alpha_;
+    double v_r_;
+};
+
+// This counts failures before the r-th success, as in
+// std::negative_binomial_distribution, by mixing a Poisson over a
+// Gamma(r, (1 - p) / p) rate.  The gamma sampler's setup is held here;
+// the Poisson setup depends on each rate draw and is cheap by design.
+struct NegativeBinomialSampler {
+    void init(float p, int r) {
+        DIST_ASSERT1(0 < p and p <= 1, "bad p: " << p);
+        DIST_ASSERT1(r >= 0, "bad r: " << r);
+        degenerate_ = (r == 0 or p == 1);
+        if (not degenerate_) {
+            scale_ = (1.0 - p) / p;
+            d_ = r - 1.0 / 3.0;
+            c_ = 1.0 / std::sqrt(9.0 * d_);
+        }
+    }
+
+    int eval(rng_t & rng) const {
+        if (DIST_UNLIKELY(degenerate_)) {
+            return 0;
+        }
+        PoissonSampler poisson;
+        poisson.init(_sample_rate(rng));
+        return poisson.eval(rng);
+    }
+
+    template<class T>
+    void fill(rng_t & rng, size_t size, T * values) const {
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = eval(rng);
+        }
+    }
+
+ private:
+    // Marsaglia-Tsang gamma sampler, valid since r >= 1
+    double _sample_rate(rng_t & rng) const {
+        std::normal_distribution<double> normal;
+        std::uniform_real_distribution<double> unif01(0.0, 1.0);
+        while (true) {
+            const double x = normal(rng);
+            double v = 1.0 + c_ * x;
+            if (v <= 0) {
+                continue;
+            }
+            v = v * v * v;
+            const double u = unif01(rng);
+            const double x2 = x * x;
+            if (u < 1.0 - 0.0331 * x2 * x2 or
+                std::log(u) < 0.5 * x2 + d_ * (1.0 - v + std::log(v))) {
+                return scale_ * d_ * v;
+            }
+        }
+    }
+
+    bool degenerate_;
+    double scale_;
+    double d_;
+    double c_;
+};
+
 inline int sample_poisson(rng_t & rng, float mean) {
-    std::poisson_distribution<int> sampler(mean);
-    return sampler(rng);
+    PoissonSampler sampler;
+    sampler.init(mean);
+    return sampler.eval(rng);
 }
 
 inline int sample_negative_binomial(rng_t & rng, float p, int r) {
-    std::negative_binomial_distribution<int> sampler(r, p);
-    return sampler(rng);
+    NegativeBinomialSampler sampler;
+    sampler.init(p, r);
+    return sampler.eval(rng);
 }
 
 inline float sample_gamma(
@@ -312,12 +466,11 @@ inline size_t sample_discrete(
     return dim - 1;
 }
 
-template<class Alloc>
 inline size_t sample_from_likelihoods(
         rng_t & rng,
-        const std::vector<float, Alloc> & likelihoods,
+        size_t size,
+        const float * likelihoods,
         float total_likelihood) {
-    const size_t size = likelihoods.size();
     DIST_ASSERT_LT(0, size);
 
     float t = total_likelihood * sample_unif01(rng);
@@ -332,6 +485,18 @@ inline size_t sample_from_likelihoods(
     return size - 1;
 }
 
+template<class Alloc>
+inline size_t sample_from_likelihoods(
+        rng_t & rng,
+        const std::vector<float, Alloc> & likelihoods,
+        float total_likelihood) {
+    return sample_from_likelihoods(
+        rng,
+        likelihoods.size(),
+        likelihoods.data(),
+        total_likelihood);
+}
+
 template<class Alloc>
 inline size_t sample_from_likelihoods(
         rng_t & rng,
@@ -348,8 +513,12 @@ inline size_t sample_from_probs(
 }
 
 // returns total likelihood
+float scores_to_likelihoods(size_t size, float * scores);
+
 template<class Alloc>
-float scores_to_likelihoods(std::vector<float, Alloc> & scores);
+inline float scores_to_likelihoods(std::vector<float, Alloc> & scores) {
+    return scores_to_likelihoods(scores.size(), scores.data());
+}
 
 template<class Alloc>
 void scores_to_probs(std::vector<float, Alloc> & scores) {
@@ -365,6 +534,13 @@ inline size_t sample_from_scores_overwrite(
     return sample_from_likelihoods(rng, scores, total);
 }
 
+inline size_t sample_from_scores_overwrite(
+        rng_t & rng,
+        AlignedFloats scores) {
+    float total = scores_to_likelihoods(scores.size(), scores.data());
+    return sample_from_likelihoods(rng, scores.size(), scores.data(), total);
+}
+
 template<class Alloc>
 inline std::pair<size_t, float> sample_prob_from_scores_overwrite(
         rng_t & rng,
@@ -383,12 +559,16 @@ float score_from_scores_overwrite(
         size_t sample,
         std::vector<float, Alloc> & scores);
 
+// Like sample_from_scores_overwrite(...) but leaves scores intact,
+// overwriting a copy in per-thread scratch space.
 template<class Alloc>
 inline size_t sample_from_scores(
         rng_t & rng,
         const std::vector<float, Alloc> & scores) {
-    std::vector<float, Alloc> scores_copy(scores);
-    return sample_from_scores_overwrite(rng, scores_copy);
+    Scratch scratch;
+    AlignedFloats likelihoods = scratch.floats(scores.size());
+    std::copy(scores.begin(), scores.end(), likelihoods.data());
+    return sample_from_scores_overwrite(rng, likelihoods);
 }
 
 }  // namespace distributions
@@ -0,0 +1,93 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+#include <distributions/common.hpp>
+#include <distributions/vector.hpp>
+
+namespace distributions {
+
+//----------------------------------------------------------------------------
+// Scratch Space
+//
+// Each thread owns one ScratchArena, a bump allocator of aligned floats
+// for temporaries that live only as long as one scoring or sampling call.
+// A Scratch scope marks the arena on construction and releases everything
+// allocated through it on destruction, so nested calls compose freely.
+// Storage is grown in chunks so earlier pointers stay valid; once fully
+// released the chunks are coalesced, after which calls of the same shape
+// do not allocate.  The arena is freed when its thread exits.
+
+class ScratchArena {
+ public:
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    ScratchArena() : blocks_(), block_(0), offset_(0) {}
+
+    static ScratchArena & thread_arena();
+
+    Mark mark() const { return Mark{block_, offset_}; }
+    float * allocate(size_t size);
+    void release(const Mark & mark);
+
+    size_t capacity() const;
+
+ private:
+    ScratchArena(const ScratchArena &) = delete;
+    void operator=(const ScratchArena &) = delete;
+
+    std::vector<VectorFloat> blocks_;
+    size_t block_;
+    size_t offset_;
+};
+
+class Scratch {
+ public:
+    Scratch() :
+        arena_(ScratchArena::thread_arena()),
+        mark_(arena_.mark()) {}
+
+    ~Scratch() { arena_.release(mark_); }
+
+    AlignedFloats floats(size_t size) {
+        return AlignedFloats(arena_.allocate(size), size);
+    }
+
+ private:
+    Scratch(const Scratch &) = delete;
+    void operator=(const Scratch &) = delete;
+
+    ScratchArena & arena_;
+    const ScratchArena::Mark mark_;
+};
+
+}  // namespace distributions
@@ -0,0 +1,104 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <distributions/common.hpp>
+
+namespace distributions {
+
+// --------------------------------------------------------------------------
+// Thread Pool
+//
+// This runs batches of small independent tasks on a fixed set of worker
+// threads, so that per-call parallelism does not pay thread startup.
+// The calling thread also works on each batch.  Batches are run one at a
+// time, so concurrent callers (e.g. Python threads sharing a pool after
+// releasing the GIL) wait their turn; parallel_for must not be called from
+// within a task.
+//
+// Workers and the caller spin briefly on atomics before parking on a
+// condition variable, so back-to-back batches do not pay a futex wakeup.
+// When the pool has more threads than cores, the spin yields instead.
+
+class ThreadPool {
+ public:
+    // thread_count includes the calling thread; zero means one per core.
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    size_t size() const { return workers_.size() + 1; }
+
+    // Calls fun(task) for each task in [0, task_count) and waits.
+    // The first exception thrown by any task is rethrown here.
+    template<class Fun>
+    void parallel_for(size_t task_count, const Fun & fun) {
+        if (task_count <= 1 or workers_.empty()) {
+            for (size_t task = 0; task < task_count; ++task) {
+                fun(task);
+            }
+        } else {
+            _run(task_count, std::function<void(size_t)>(std::cref(fun)));
+        }
+    }
+
+ private:
+    ThreadPool(const ThreadPool &) = delete;
+    void operator=(const ThreadPool &) = delete;
+
+    void _run(size_t task_count, const std::function<void(size_t)> & fun);
+    void _work();
+    void _do_tasks();
+    void _wait_for_batch(size_t generation);
+    void _wait_for_workers();
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable started_;
+    std::condition_variable finished_;
+    const std::function<void(size_t)> * fun_;
+    size_t task_count_;
+    std::atomic<size_t> next_task_;
+    std::exception_ptr error_;
+    std::atomic<size_t> busy_workers_;
+    std::atomic<size_t> generation_;
+    std::atomic<bool> stopping_;
+    std::atomic<size_t> parked_workers_;
+    std::atomic<bool> caller_parked_;
+    size_t spin_count_;
+    bool spin_yields_;
+};
+
+}   // namespace distributions
@@ -146,6 +146,7 @@ lp_extensions = make_extensions([
     'lp.special',
     'lp.random',
     'lp.vector',
+    'lp.thread_pool',
     'lp.models.bb',
     'lp.models._bb',
     'lp.models.dd',
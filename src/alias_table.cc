@@ -0,0 +1,79 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <distributions/alias_table.hpp>
+
+namespace distributions {
+
+void AliasTable::init(const float * scores, size_t size) {
+    DIST_ASSERT1(size, "cannot build an empty alias table");
+    probs_.resize(size);
+    aliases_.resize(size);
+    scores_.resize(size);
+
+    const float max_score = * std::max_element(scores, scores + size);
+    double total = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const float likelihood = expf(scores[i] - max_score);
+        probs_[i] = likelihood;
+        total += likelihood;
+    }
+    const float shift = max_score + logf(total);
+    const float scale = size / total;
+    small_.clear();
+    large_.clear();
+    for (size_t i = 0; i < size; ++i) {
+        scores_[i] = scores[i] - shift;
+        probs_[i] *= scale;
+        aliases_[i] = i;
+        (probs_[i] < 1.f ? small_ : large_).push_back(i);
+    }
+
+    while (not small_.empty() and not large_.empty()) {
+        const uint32_t less = small_.back();
+        const uint32_t more = large_.back();
+        small_.pop_back();
+        aliases_[less] = more;
+        probs_[more] -= 1.f - probs_[less];
+        if (probs_[more] < 1.f) {
+            large_.pop_back();
+            small_.push_back(more);
+        }
+    }
+
+    // entries left over from rounding keep themselves with certainty
+    for (uint32_t i : small_) {
+        probs_[i] = 1.f;
+    }
+    for (uint32_t i : large_) {
+        probs_[i] = 1.f;
+    }
+}
+
+}   // namespace distributions
@@ -34,6 +34,17 @@ namespace distributions {
 // --------------------------------------------------------------------------
 // Assignments
 
+template<class count_t>
+inline void validate_contiguous(const std::vector<count_t> & counts) {
+    if (DIST_DEBUG_LEVEL >= 2) {
+        if (not counts.empty()) {
+            count_t min_count =
+                * std::min_element(counts.begin(), counts.end());
+            DIST_ASSERT(min_count > 0, "groups are not contiguous");
+        }
+    }
+}
+
 template<class count_t>
 std::vector<count_t> Clustering<count_t>::count_assignments(
         const Assignments & assignments) {
@@ -51,25 +62,166 @@ std::vector<count_t> Clustering<count_t>::count_assignments(
         ++counts[gid];
     }
 
-    if (DIST_DEBUG_LEVEL >= 2) {
-        if (not counts.empty()) {
-            count_t min_count =
-                * std::min_element(counts.begin(), counts.end());
-            DIST_ASSERT(min_count > 0, "groups are not contiguous");
+    validate_contiguous(counts);
+
+    return counts;
+}
+
+template<class count_t>
+void Clustering<count_t>::count_assignments(
+        const count_t * assignments,
+        size_t size,
+        std::vector<count_t> & counts) {
+    counts.clear();
+    for (size_t i = 0; i < size; ++i) {
+        const size_t gid = assignments[i];
+        if (DIST_UNLIKELY(gid >= counts.size())) {
+            DIST_ASSERT(gid < size, "bad groupid: " << gid);
+            counts.resize(gid + 1, 0);
         }
+        ++counts[gid];
     }
 
-    return counts;
+    validate_contiguous(counts);
+}
+
+template<class count_t>
+void Clustering<count_t>::count_assignments(
+        const count_t * assignments,
+        size_t size,
+        std::vector<count_t> & counts,
+        ThreadPool & pool) {
+    // Each task histograms a contiguous chunk into private counts, which
+    // are then summed.  Chunks are large enough to amortize the final
+    // reduction over groups.  A first pass finds the largest groupid, so
+    // that ids are validated and buffers allocated once, before counting.
+    const size_t min_chunk_size = 1 << 18;
+    const size_t chunk_count = std::min(pool.size(), size / min_chunk_size);
+    if (chunk_count <= 1) {
+        count_assignments(assignments, size, counts);
+        return;
+    }
+    auto chunk_begin = [&](size_t chunk) {
+        return size * chunk / chunk_count;
+    };
+
+    std::vector<size_t> partial_max(chunk_count, 0);
+    pool.parallel_for(chunk_count, [&](size_t chunk) {
+        size_t max_gid = 0;
+        for (size_t i = chunk_begin(chunk), end = chunk_begin(chunk + 1);
+                i < end; ++i) {
+            max_gid = std::max(max_gid, size_t(assignments[i]));
+        }
+        partial_max[chunk] = max_gid;
+    });
+    const size_t max_gid =
+        * std::max_element(partial_max.begin(), partial_max.end());
+    DIST_ASSERT(max_gid < size, "bad groupid: " << max_gid);
+    const size_t group_count = max_gid + 1;
+
+    counts.assign(group_count, 0);
+    std::vector<std::vector<count_t>> partial_counts(chunk_count - 1);
+    for (auto & local : partial_counts) {
+        local.assign(group_count, 0);
+    }
+    pool.parallel_for(chunk_count, [&](size_t chunk) {
+        count_t * local = chunk ? partial_counts[chunk - 1].data()
+                                : counts.data();
+        for (size_t i = chunk_begin(chunk), end = chunk_begin(chunk + 1);
+                i < end; ++i) {
+            ++local[size_t(assignments[i])];
+        }
+    });
+
+    for (const auto & local : partial_counts) {
+        for (size_t i = 0; i < group_count; ++i) {
+            counts[i] += local[i];
+        }
+    }
+
+    validate_contiguous(counts);
+}
+
+template<class count_t>
+typename Clustering<count_t>::CountHistogram
+Clustering<count_t>::count_counts(const std::vector<count_t> & counts) {
+    // Most groups are small, so small sizes are tallied densely,
+    // and the few large sizes are sorted and run-length encoded.
+    const size_t dense_size = 256;
+    count_t dense[dense_size] = {0};
+    std::vector<count_t> sparse;
+
+    CountHistogram histogram;
+    histogram.sample_size = 0;
+    histogram.group_count = 0;
+    for (count_t count : counts) {
+        if (count) {
+            histogram.sample_size += count;
+            histogram.group_count += 1;
+            if (DIST_LIKELY(static_cast<size_t>(count) < dense_size)) {
+                ++dense[count];
+            } else {
+                sparse.push_back(count);
+            }
+        }
+    }
+
+    auto & bins = histogram.bins;
+    for (size_t size = 1; size < dense_size; ++size) {
+        if (dense[size]) {
+            bins.push_back(std::make_pair(count_t(size), dense[size]));
+        }
+    }
+    std::sort(sparse.begin(), sparse.end());
+    for (count_t size : sparse) {
+        if (bins.empty() or bins.back().first != size) {
+            bins.push_back(std::make_pair(size, count_t(0)));
+        }
+        ++bins.back().second;
+    }
+
+    return histogram;
 }
 
 
 // --------------------------------------------------------------------------
 // Pitman-Yor Model
 
+template<class count_t>
+float Clustering<count_t>::PitmanYor::expected_group_count(
+        count_t sample_size) const {
+    // asymptotic approximations for large sample_size
+    const float n = sample_size;
+    if (d > 0) {
+        float log_coeff = lgammaf(alpha + 1) - lgammaf(alpha + d);
+        return expf(log_coeff + d * logf(n)) / d;
+    } else {
+        return alpha * logf(1 + n / alpha);
+    }
+}
+
 template<class count_t>
 std::vector<count_t> Clustering<count_t>::PitmanYor::sample_assignments(
         count_t size,
         rng_t & rng) const {
+    // The scan sampler counts in float precision, which saturates at 2^24,
+    // and its cost grows with the number of tables it must scan past;
+    // benchmarks/sample_assignment_from_py shows a crossover near 200.
+    const count_t max_scan_size = 1 << 24;
+    const float max_scan_group_count = 200;
+
+    if (size > max_scan_size or
+            expected_group_count(size) > max_scan_group_count) {
+        return sample_assignments_tree(size, rng);
+    } else {
+        return sample_assignments_scan(size, rng);
+    }
+}
+
+template<class count_t>
+std::vector<count_t> Clustering<count_t>::PitmanYor::sample_assignments_scan(
+        count_t size,
+        rng_t & rng) const {
     // Note that we can ignore the constant shift of -log(size + alpha) in
     //
     //   float py.score_add_value(
@@ -141,45 +293,135 @@ std::vector<count_t> Clustering<count_t>::PitmanYor::sample_assignments(
     return assignments;
 }
 
-inline float fast_log_ratio(float numer, float denom) {
-    return fast_log(numer / denom);
+template<class count_t>
+std::vector<count_t> Clustering<count_t>::PitmanYor::sample_assignments_tree(
+        count_t size,
+        rng_t & rng) const {
+    // This is the same process as sample_assignments_scan, but likelihoods
+    // are kept in a Fenwick tree, so each seating costs O(log(table_count))
+    // regardless of how slowly the likelihoods decay.
+
+    std::vector<count_t> assignments(size);
+    FenwickTree likelihoods;
+    likelihoods.reserve(100);  // just pick something safe
+
+    // initialize empty table
+    count_t table_count = 0;
+    const double py_likelihood_new = 1 - d;
+    likelihoods.push_back(alpha);
+
+    for (count_t i = 0; DIST_LIKELY(i < size); ++i) {
+        count_t assign = sample_from_likelihoods(rng, likelihoods);
+        assignments[i] = assign;
+
+        if (DIST_UNLIKELY(assign == table_count)) {
+            // new table
+            table_count += 1;
+            likelihoods.set(assign, py_likelihood_new);
+            likelihoods.push_back(alpha + d * table_count);
+
+        } else {
+            // existing table
+            likelihoods.add(assign, 1.0);
+        }
+    }
+
+    return assignments;
+}
+
+// The Pitman-Yor probability of a partition with K groups of sizes n_i,
+// summing to n, factors as
+//
+//   prod_{k<K} (alpha + d k) prod_i (1-d)_{n_i-1} / (alpha)_n
+//
+// where (x)_m = Gamma(x + m) / Gamma(x).  The middle factor depends only on
+// the histogram of group sizes and on d; the outer factors depend only on
+// K and n, and have closed forms.
+
+template<class Bins>
+inline double pitman_yor_size_terms(const Bins & bins, float d) {
+    // fast_lgamma loses absolute precision for large sizes, which are rare
+    const size_t max_fast_size = 256;
+    const float lgamma_shift = fast_lgamma(1 - d);
+    const float log_second = fast_log(1 - d);
+    double score = 0.0;
+    for (const auto & bin : bins) {
+        const size_t size = bin.first;
+        const double group_count = bin.second;
+        if (size == 2) {
+            score += group_count * log_second;
+        } else if (DIST_LIKELY(size < max_fast_size)) {
+            if (size > 2) {
+                score += group_count * (fast_lgamma(size - d) - lgamma_shift);
+            }
+        } else {
+            const double shift = 1.0 - d;
+            score += group_count * (lgamma(size - 1 + shift) - lgamma(shift));
+        }
+    }
+    return score;
 }
 
-inline float fast_lgamma_ratio(float start, size_t count) {
-    return fast_lgamma(start + count) - fast_lgamma(start);
+inline double pitman_yor_table_terms(
+        size_t group_count,
+        size_t sample_size,
+        double alpha,
+        double d) {
+    // Beyond this, lgamma(alpha / d) cancels catastrophically.
+    const double max_closed_form_ratio = 1e8;
+
+    const double K = group_count;
+    double score = 0.0;
+    if (d == 0) {
+        score += K * log(alpha);
+    } else if (alpha / d < max_closed_form_ratio) {
+        const double shift = alpha / d;
+        score += K * log(d) + lgamma(shift + K) - lgamma(shift);
+    } else {
+        for (size_t k = 0; k < group_count; ++k) {
+            score += log(alpha + d * k);
+        }
+    }
+    score -= lgamma(alpha + sample_size) - lgamma(alpha);
+    return score;
 }
 
 template<class count_t>
 float Clustering<count_t>::PitmanYor::score_counts(
         const std::vector<count_t> & counts) const {
-    double score = 0.0;
-    size_t sample_size = 0;
-    size_t nonempty_group_count = 0;
-
-    for (size_t count : counts) {
-        if (count) {
-            if (count == 1) {
-                score += fast_log_ratio(
-                    alpha + d * nonempty_group_count,
-                    alpha + sample_size);
-
-            } else if (count == 2) {
-                score += fast_log_ratio(
-                    (alpha + d * nonempty_group_count) * (1 - d),
-                    (alpha + sample_size) * (alpha + sample_size + 1));
+    return score_counts(count_counts(counts));
+}
 
-            } else {
-                score += fast_log(alpha + d * nonempty_group_count);
-                score += fast_lgamma_ratio(1 - d, count - 1);
-                score -= fast_lgamma_ratio(alpha + sample_size, count);
-            }
+template<class count_t>
+float Clustering<count_t>::PitmanYor::score_counts(
+        const CountHistogram & histogram) const {
+    return pitman_yor_size_terms(histogram.bins, d)
+         + pitman_yor_table_terms(
+            histogram.group_count,
+            histogram.sample_size,
+            alpha,
+            d);
+}
 
-            nonempty_group_count += 1;
-            sample_size += count;
+template<class count_t>
+void Clustering<count_t>::PitmanYor::score_counts_grid(
+        const CountHistogram & histogram,
+        const std::vector<PitmanYor> & grid,
+        std::vector<float> & scores) {
+    const size_t size = grid.size();
+    scores.resize(size);
+    double size_terms = 0.0;
+    for (size_t i = 0; i < size; ++i) {
+        const PitmanYor & model = grid[i];
+        if (i == 0 or model.d != grid[i - 1].d) {
+            size_terms = pitman_yor_size_terms(histogram.bins, model.d);
         }
+        scores[i] = size_terms + pitman_yor_table_terms(
+            histogram.group_count,
+            histogram.sample_size,
+            model.alpha,
+            model.d);
     }
-
-    return score;
 }
 
 // --------------------------------------------------------------------------
@@ -253,11 +495,17 @@ std::vector<count_t> Clustering<count_t>::LowEntropy::sample_assignments(
         rng_t & rng) const {
     DIST_ASSERT_LE(sample_size, dataset_size);
 
+    // Likelihoods are kept in a Fenwick tree so that each draw costs
+    // O(log(group_count)) rather than a full sum over groups.  Nonempty
+    // group likelihoods depend only on group size, so they are cached.
+
     std::vector<count_t> assignments(sample_size);
     std::vector<count_t> counts;
-    std::vector<float> likelihoods;
+    std::vector<float> likelihoods_by_size;
+    FenwickTree likelihoods;
     counts.reserve(100);
     likelihoods.reserve(100);
+    likelihoods_by_size.push_back(0);
     const count_t bogus = 0;
     count_t size = 0;
 
@@ -267,16 +515,18 @@ std::vector<count_t> Clustering<count_t>::LowEntropy::sample_assignments(
             counts.push_back(0);
             likelihoods.push_back(likelihood_empty);
         } else {
-            likelihoods.back() = likelihood_empty;
+            likelihoods.set(counts.size() - 1, likelihood_empty);
         }
 
         assign = sample_from_likelihoods(rng, likelihoods);
         count_t & count = counts[assign];
         count += 1;
         size += 1;
-        float & likelihood = likelihoods[assign];
-        float new_likelihood = fast_exp(score_add_value(count, bogus, bogus));
-        likelihood = new_likelihood;
+        if (DIST_UNLIKELY(size_t(count) == likelihoods_by_size.size())) {
+            float likelihood = fast_exp(score_add_value(count, bogus, bogus));
+            likelihoods_by_size.push_back(likelihood);
+        }
+        likelihoods.set(assign, likelihoods_by_size[count]);
     }
 
     return assignments;
@@ -287,10 +537,8 @@ std::vector<count_t> Clustering<count_t>::LowEntropy::sample_assignments(
 // Explicit template instantiation
 
 template struct Clustering<int32_t>;
-#if 0
 template struct Clustering<int64_t>;
 template struct Clustering<uint32_t>;
 template struct Clustering<uint64_t>;
-#endif
 
 }   // namespace distributions
@@ -0,0 +1,96 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <distributions/models/bnb.hpp>
+#include <distributions/scratch.hpp>
+#include <distributions/vector_math.hpp>
+
+namespace distributions {
+
+// Small values need no lgamma at all: the ratio
+//   Gamma(b + v) / Gamma(b + a + v) * Gamma(b + a) / Gamma(b)
+// is a product of v < small_value_limit factors, which stays well inside
+// float range, so a single vectorized log finishes the job.
+// Larger values batch both lgamma terms through one vector_lgamma pass.
+void BetaNegativeBinomial::MixtureValueScorer::score_value_range(
+        const Shared &,
+        const std::vector<Group> &,
+        const Value & value,
+        size_t begin,
+        AlignedFloats scores_accum,
+        rng_t &) const {
+    const size_t size = scores_accum.size();
+    float * __restrict__ scores_accum_noalias =
+        VectorFloat_data(scores_accum);
+    const float * __restrict__ post_beta =
+        VectorFloat_data(post_beta_) + begin;
+    const float * __restrict__ alpha = VectorFloat_data(alpha_) + begin;
+    Scratch scratch;
+
+    if (DIST_LIKELY(value < small_value_limit)) {
+        const float * __restrict__ zero_score =
+            VectorFloat_data(zero_score_) + begin;
+        if (value == 0) {
+            vector_add(size, scores_accum_noalias, zero_score);
+            return;
+        }
+
+        float * __restrict__ temp = scratch.floats(size).data();
+        for (size_t i = 0; i < size; ++i) {
+            temp[i] = post_beta[i] / (post_beta[i] + alpha[i]);
+        }
+        for (Value v = 1; v < value; ++v) {
+            for (size_t i = 0; i < size; ++i) {
+                const float beta = post_beta[i] + v;
+                temp[i] *= beta / (beta + alpha[i]);
+            }
+        }
+        vector_log(size, temp);
+        for (size_t i = 0; i < size; ++i) {
+            scores_accum_noalias[i] += zero_score[i] + temp[i];
+        }
+
+    } else {
+        const float * __restrict__ score = VectorFloat_data(score_) + begin;
+        const float value_noalias = value;
+        float * __restrict__ temp = scratch.floats(2 * size).data();
+        float * __restrict__ lgamma_beta = temp;
+        float * __restrict__ lgamma_beta_alpha = temp + size;
+        for (size_t i = 0; i < size; ++i) {
+            const float beta = post_beta[i] + value_noalias;
+            lgamma_beta[i] = beta;
+            lgamma_beta_alpha[i] = beta + alpha[i];
+        }
+        vector_lgamma(2 * size, temp);
+        for (size_t i = 0; i < size; ++i) {
+            scores_accum_noalias[i] +=
+                score[i] + lgamma_beta[i] - lgamma_beta_alpha[i];
+        }
+    }
+}
+
+}   // namespace distributions
@@ -25,44 +25,78 @@
 // TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
 // USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <distributions/models/gp.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector_math.hpp>
 
 namespace distributions {
-void GammaPoisson::MixtureValueScorer::score_value(
+
+// Small values avoid lgamma: with a = post_alpha,
+//   lgamma(a + v) - log(v!) = lgamma(a) + sum_{i < v} log((a + i) / (i + 1)).
+// The factors are multiplied in runs of at most four, keeping each product
+// inside float range even for large a, and all runs share one vector_log.
+void GammaPoisson::MixtureValueScorer::score_value_range(
         const Shared &,
         const std::vector<Group> &,
         const Value & value,
+        size_t begin,
         AlignedFloats scores_accum,
         rng_t &) const {
     const size_t size = scores_accum.size();
-
-    static thread_local VectorFloat * temp_ = nullptr;
-    if (DIST_UNLIKELY(not temp_)) {
-        temp_ = new VectorFloat(size);  // never freed
-    } else {
-        temp_->resize(size);
-    }
-
     const float value_noalias = value;
     float * __restrict__ scores_accum_noalias =
         VectorFloat_data(scores_accum);
-    const float * __restrict__ score = VectorFloat_data(score_);
     const float * __restrict__ post_alpha =
-        VectorFloat_data(post_alpha_);
+        VectorFloat_data(post_alpha_) + begin;
     const float * __restrict__ score_coeff =
-        VectorFloat_data(score_coeff_);
-    float * __restrict__ temp = VectorFloat_data(*temp_);
+        VectorFloat_data(score_coeff_) + begin;
+    Scratch scratch;
 
-    const float log_factorial_value = fast_log_factorial(value);
-    for (size_t i = 0; i < size; ++i) {
-        temp[i] = fast_lgamma(post_alpha[i] + value_noalias);
-    }
-    for (size_t i = 0; i < size; ++i) {
-        scores_accum_noalias[i] += score[i]
-            + temp[i]
-            - log_factorial_value
-            + score_coeff[i] * value_noalias;
+    if (DIST_LIKELY(value < small_value_limit)) {
+        const float * __restrict__ zero_score =
+            VectorFloat_data(zero_score_) + begin;
+        const Value run_size = 4;
+        const Value run_count = (value + run_size - 1) / run_size;
+        float * __restrict__ temp = scratch.floats(run_count * size).data();
+        for (Value run = 0; run < run_count; ++run) {
+            float * __restrict__ product = temp + run * size;
+            const Value run_begin = run * run_size;
+            const Value run_end = std::min(value, run_begin + run_size);
+            for (size_t i = 0; i < size; ++i) {
+                product[i] = 1.f;
+            }
+            for (Value v = run_begin; v < run_end; ++v) {
+                const float shift = v;
+                const float scale = 1.f / (v + 1);
+                for (size_t i = 0; i < size; ++i) {
+                    product[i] *= (post_alpha[i] + shift) * scale;
+                }
+            }
+        }
+        vector_log(run_count * size, temp);
+        for (size_t i = 0; i < size; ++i) {
+            scores_accum_noalias[i] +=
+                zero_score[i] + score_coeff[i] * value_noalias;
+        }
+        for (Value run = 0; run < run_count; ++run) {
+            vector_add(size, scores_accum_noalias, temp + run * size);
+        }
+
+    } else {
+        const float * __restrict__ score = VectorFloat_data(score_) + begin;
+        float * __restrict__ temp = scratch.floats(size).data();
+        for (size_t i = 0; i < size; ++i) {
+            temp[i] = post_alpha[i] + value_noalias;
+        }
+        vector_lgamma(size, temp);
+        const float log_factorial_value = fast_log_factorial(value);
+        for (size_t i = 0; i < size; ++i) {
+            scores_accum_noalias[i] += score[i]
+                + temp[i]
+                - log_factorial_value
+                + score_coeff[i] * value_noalias;
+        }
     }
 }
 
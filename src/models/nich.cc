@@ -26,35 +26,33 @@
 // USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <distributions/models/nich.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/vector_math.hpp>
 
 namespace distributions {
 
-void NormalInverseChiSq::MixtureValueScorer::score_value(
+void NormalInverseChiSq::MixtureValueScorer::score_value_range(
         const Shared &,
         const std::vector<Group> &,
         const Value & value,
+        size_t begin,
         AlignedFloats scores_accum,
         rng_t &) const {
     const size_t size = scores_accum.size();
 
-    static thread_local VectorFloat * temp_ = nullptr;
-    if (DIST_UNLIKELY(not temp_)) {
-        temp_ = new VectorFloat(size);  // never freed
-    } else {
-        temp_->resize(size);
-    }
+    Scratch scratch;
+    AlignedFloats temps = scratch.floats(size);
 
     const float value_noalias = value;
     float * __restrict__ scores_accum_noalias = VectorFloat_data(scores_accum);
     const float * __restrict__ score =
-        VectorFloat_data(score_);
+        VectorFloat_data(score_) + begin;
     const float * __restrict__ log_coeff =
-        VectorFloat_data(log_coeff_);
+        VectorFloat_data(log_coeff_) + begin;
     const float * __restrict__ precision =
-        VectorFloat_data(precision_);
-    const float * __restrict__ mean = VectorFloat_data(mean_);
-    float * __restrict__ temp = VectorFloat_data(*temp_);
+        VectorFloat_data(precision_) + begin;
+    const float * __restrict__ mean = VectorFloat_data(mean_) + begin;
+    float * __restrict__ temp = VectorFloat_data(temps);
 
     // Version 1
     for (size_t i = 0; i < size; ++i) {
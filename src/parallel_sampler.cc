@@ -0,0 +1,129 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <distributions/parallel_sampler.hpp>
+#include <distributions/random.hpp>
+
+namespace distributions {
+
+ParallelGroupSampler::ParallelGroupSampler(
+        ThreadPool & pool,
+        size_t min_chunk_size) :
+    pool_(pool),
+    min_chunk_size_(std::max(min_chunk_size, size_t(1))),
+    group_count_(0),
+    chunks_(),
+    rngs_() {
+}
+
+void ParallelGroupSampler::_plan(rng_t & rng, size_t group_count) {
+    if (DIST_LIKELY(group_count == group_count_)) {
+        return;
+    }
+    group_count_ = group_count;
+
+    // chunks are whole cache lines, so that each chunk stays aligned
+    // and no two tasks write the same line
+    const size_t line = 64 / sizeof(float);
+    size_t chunk_count = std::min(
+        pool_.size(),
+        std::max(group_count / min_chunk_size_, size_t(1)));
+    size_t chunk_size = (group_count + chunk_count - 1) / chunk_count;
+    chunk_size = (chunk_size + line - 1) / line * line;
+    chunk_count = (group_count + chunk_size - 1) / chunk_size;
+
+    chunks_.resize(chunk_count);
+    for (size_t c = 0; c < chunk_count; ++c) {
+        chunks_[c].begin = c * chunk_size;
+        chunks_[c].end = std::min((c + 1) * chunk_size, group_count);
+    }
+    while (rngs_.size() < chunk_count) {
+        rngs_.push_back(rng_t(rng()));
+    }
+}
+
+void ParallelGroupSampler::_to_likelihoods(
+        Chunk & chunk,
+        AlignedFloats scores) {
+    const size_t size = scores.size();
+    float * __restrict__ data = scores.data();
+    const float max_score = vector_max(size, data);
+    float total = 0;
+    for (size_t i = 0; i < size; ++i) {
+        total += data[i] = fast_exp(data[i] - max_score);
+    }
+    chunk.max_score = max_score;
+    chunk.total = total;
+}
+
+size_t ParallelGroupSampler::_sample(
+        rng_t & rng,
+        const VectorFloat & likelihoods) const {
+    float max_score = chunks_[0].max_score;
+    for (const Chunk & chunk : chunks_) {
+        max_score = std::max(max_score, chunk.max_score);
+    }
+    double total = 0;
+    for (const Chunk & chunk : chunks_) {
+        total += chunk.total * fast_exp(chunk.max_score - max_score);
+    }
+
+    // Chunks far below the max can underflow to zero total; never land on
+    // one, since rounding may carry t past every earlier chunk.
+    size_t last = chunks_.size() - 1;
+    while (last and
+           chunks_[last].total * fast_exp(chunks_[last].max_score - max_score)
+           <= 0) {
+        --last;
+    }
+
+    double t = total * sample_unif01(rng);
+    for (size_t c = 0; c <= last; ++c) {
+        const Chunk & chunk = chunks_[c];
+        const float scale = fast_exp(chunk.max_score - max_score);
+        const double chunk_total = chunk.total * scale;
+        if (t < chunk_total or c == last) {
+            float local = std::min(t / scale, double(chunk.total));
+            for (size_t i = chunk.begin; i < chunk.end; ++i) {
+                if (DIST_UNLIKELY((local -= likelihoods[i]) < 0)) {
+                    return i;
+                }
+            }
+            // rounding left local >= 0; take the last possible group
+            size_t i = chunk.end - 1;
+            while (i > chunk.begin and not (likelihoods[i] > 0)) {
+                --i;
+            }
+            return i;
+        }
+        t -= chunk_total;
+    }
+    return group_count_ - 1;
+}
+
+}   // namespace distributions
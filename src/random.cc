@@ -91,10 +91,8 @@ float log_sum_exp(const std::vector<float, Alloc> & scores) {
     return fast_log(total) + max_score;
 }
 
-template<class Alloc>
-float scores_to_likelihoods(std::vector<float, Alloc> & scores) {
-    const size_t size = scores.size();
-    float * __restrict__ scores_data = scores.data();
+float scores_to_likelihoods(size_t size, float * scores) {
+    float * __restrict__ scores_data = scores;
     float max_score = vector_max(size, scores_data);
 
     float total = 0;
@@ -133,8 +131,6 @@ float score_from_scores_overwrite(
 #define INSTANTIATE_TEMPLATES(Alloc)                \
     template float log_sum_exp(                     \
             const std::vector<float, Alloc> &);     \
-    template float scores_to_likelihoods(           \
-            std::vector<float, Alloc> &);           \
     template float score_from_scores_overwrite(     \
             rng_t &,                                \
             size_t,                                 \
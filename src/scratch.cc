@@ -0,0 +1,93 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <distributions/scratch.hpp>
+
+namespace distributions {
+
+namespace {
+// Allocations are rounded up to whole aligned lines,
+// so that every pointer handed out is itself aligned.
+const size_t line_size = default_alignment / sizeof(float);
+const size_t min_block_size = 4096;
+
+inline size_t round_up(size_t size) {
+    return (size + line_size - 1) / line_size * line_size;
+}
+}  // namespace
+
+ScratchArena & ScratchArena::thread_arena() {
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+float * ScratchArena::allocate(size_t size) {
+    size = round_up(std::max(size, size_t(1)));
+    if (DIST_UNLIKELY(blocks_.empty())) {
+        blocks_.push_back(VectorFloat(std::max(size, min_block_size)));
+    }
+    if (DIST_UNLIKELY(offset_ + size > blocks_[block_].size())) {
+        // Blocks past block_ hold no live data, so they may be replaced.
+        const size_t next_size =
+            std::max(size, 2 * round_up(blocks_[block_].size()));
+        ++block_;
+        offset_ = 0;
+        if (block_ == blocks_.size()) {
+            blocks_.push_back(VectorFloat(next_size));
+        } else if (blocks_[block_].size() < size) {
+            blocks_[block_] = VectorFloat(next_size);
+        }
+    }
+    float * result = blocks_[block_].data() + offset_;
+    offset_ += size;
+    return result;
+}
+
+void ScratchArena::release(const Mark & mark) {
+    DIST_ASSERT2(
+        mark.block < block_ or
+        (mark.block == block_ and mark.offset <= offset_),
+        "scratch released out of order");
+    block_ = mark.block;
+    offset_ = mark.offset;
+    if (DIST_UNLIKELY(offset_ == 0 and block_ == 0 and blocks_.size() > 1)) {
+        const size_t total = capacity();
+        blocks_.clear();
+        blocks_.push_back(VectorFloat(total));
+    }
+}
+
+size_t ScratchArena::capacity() const {
+    size_t total = 0;
+    for (const auto & block : blocks_) {
+        total += block.size();
+    }
+    return total;
+}
+
+}  // namespace distributions
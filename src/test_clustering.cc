@@ -0,0 +1,247 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <distributions/common.hpp>
+#include <distributions/assert_close.hpp>
+#include <distributions/clustering.hpp>
+#include <distributions/fenwick.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+template<class count_t, class Mixture>
+void test_mixture(const typename Mixture::Model & model, count_t big) {
+    Mixture mixture;
+    mixture.counts() = {big, big / 2, 0, 1};
+    mixture.init(model);
+    const size_t sample_size = size_t(big) + size_t(big / 2) + 1;
+    DIST_ASSERT_EQ(mixture.sample_size(), sample_size);
+    DIST_ASSERT_EQ(mixture.empty_groupids().size(), 1);
+
+    DIST_ASSERT(mixture.add_value(model, 2), "expected a new group");
+    DIST_ASSERT_EQ(mixture.counts().size(), 5);
+    mixture.add_value(model, 0, big / 4);
+    DIST_ASSERT_EQ(mixture.counts(0), big + big / 4);
+    DIST_ASSERT(mixture.remove_value(model, 3), "expected a removed group");
+    DIST_ASSERT_EQ(mixture.sample_size(), sample_size + big / 4);
+
+    VectorFloat scores(mixture.counts().size());
+    mixture.score_value(model, scores);
+    for (float score : scores) {
+        DIST_ASSERT_LT(-1e30f, score);
+        DIST_ASSERT_LT(score, 1e30f);
+    }
+    float score = mixture.score_data(model);
+    DIST_ASSERT_LT(-1e30f, score);
+    DIST_ASSERT_LT(score, 0);
+
+    std::vector<count_t> counts = mixture.counts();
+    auto histogram = Clustering<count_t>::count_counts(counts);
+    DIST_ASSERT_EQ(size_t(histogram.sample_size), mixture.sample_size());
+    DIST_ASSERT_EQ(size_t(histogram.group_count), counts.size() - 1);
+}
+
+template<class count_t>
+void test_clustering(count_t big) {
+    typedef Clustering<count_t> clustering;
+    rng_t rng;
+
+    typename clustering::Assignments assignments;
+    for (count_t i = 0; i < 100; ++i) {
+        assignments[big + i] = i % 3;
+    }
+    auto counts = clustering::count_assignments(assignments);
+    DIST_ASSERT_EQ(counts.size(), 3);
+    DIST_ASSERT_EQ(counts[0], 34);
+
+    std::vector<count_t> dense(1 << 20);
+    for (size_t i = 0; i < dense.size(); ++i) {
+        dense[i] = i % 3;
+    }
+    clustering::count_assignments(dense.data(), dense.size(), counts);
+    DIST_ASSERT_EQ(counts.size(), 3);
+    DIST_ASSERT_EQ(size_t(counts[0]), (dense.size() + 2) / 3);
+    clustering::count_assignments(dense.data(), 0, counts);
+    DIST_ASSERT_EQ(counts.size(), 0);
+
+    ThreadPool pool(3);
+    clustering::count_assignments(dense.data(), dense.size(), counts, pool);
+    DIST_ASSERT_EQ(counts.size(), 3);
+    DIST_ASSERT_EQ(size_t(counts[0]), (dense.size() + 2) / 3);
+    DIST_ASSERT_EQ(size_t(counts[2]), dense.size() / 3);
+    clustering::count_assignments(dense.data(), 0, counts, pool);
+    DIST_ASSERT_EQ(counts.size(), 0);
+
+    std::vector<std::vector<count_t>> concurrent_counts(4);
+    std::vector<std::thread> callers;
+    for (auto & local : concurrent_counts) {
+        callers.push_back(std::thread([&]() {
+            clustering::count_assignments(
+                dense.data(), dense.size(), local, pool);
+        }));
+    }
+    for (auto & caller : callers) {
+        caller.join();
+    }
+    for (const auto & local : concurrent_counts) {
+        DIST_ASSERT_EQ(local.size(), 3);
+        DIST_ASSERT_EQ(size_t(local[0]), (dense.size() + 2) / 3);
+    }
+
+    typename clustering::PitmanYor pitman_yor;
+    pitman_yor.alpha = 2.f;
+    pitman_yor.d = 0.5f;
+    const count_t size = 1000;
+    auto sample = pitman_yor.sample_assignments(size, rng);
+    DIST_ASSERT_EQ(sample.size(), size);
+    test_mixture<count_t, typename clustering::PitmanYor::Mixture>(
+        pitman_yor,
+        big);
+
+    typename clustering::LowEntropy low_entropy;
+    low_entropy.dataset_size = 3 * big;
+    sample = low_entropy.sample_assignments(size, rng);
+    DIST_ASSERT_EQ(sample.size(), size);
+    test_mixture<count_t, typename clustering::LowEntropy::Mixture>(
+        low_entropy,
+        big);
+}
+
+void test_fenwick_tree(rng_t & rng) {
+    FenwickTree tree;
+    std::vector<double> values;
+    for (size_t i = 0; i < 37; ++i) {
+        values.push_back(sample_unif01(rng) * (i % 5));
+        tree.push_back(values.back());
+    }
+    for (size_t i = 0; i < values.size(); i += 3) {
+        values[i] += 1.5;
+        tree.add(i, 1.5);
+    }
+    for (size_t i = 1; i < values.size(); i += 7) {
+        values[i] = 0.25;
+        tree.set(i, 0.25);
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        DIST_ASSERT_EQ(tree[i], values[i]);
+        total += values[i];
+    }
+    DIST_ASSERT_CLOSE(tree.total(), total);
+
+    // find returns the first pos whose prefix sum exceeds t;
+    // probe just inside each nonempty range
+    double prefix = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i] > 0) {
+            DIST_ASSERT_EQ(tree.find(prefix + 1e-6), i);
+            DIST_ASSERT_EQ(tree.find(prefix + values[i] - 1e-6), i);
+        }
+        prefix += values[i];
+    }
+    DIST_ASSERT_EQ(tree.find(total * 2), values.size() - 1);
+}
+
+// The tree sampler is used only above a size crossover; force it here
+// and check it against the exact partition probabilities.
+template<class count_t>
+void test_sample_assignments_tree(rng_t & rng) {
+    typedef Clustering<count_t> clustering;
+    typename clustering::PitmanYor pitman_yor;
+    pitman_yor.alpha = 1.5f;
+    pitman_yor.d = 0.3f;
+
+    const count_t size = 5;
+    const size_t sample_count = 100000;
+    std::map<std::vector<count_t>, size_t> samples;
+    for (size_t i = 0; i < sample_count; ++i) {
+        ++samples[pitman_yor.sample_assignments_tree(size, rng)];
+    }
+    double distance = 0;
+    double total_prob = 0;
+    for (const auto & pair : samples) {
+        std::vector<count_t> counts;
+        for (count_t groupid : pair.first) {
+            if (size_t(groupid) >= counts.size()) {
+                counts.resize(size_t(groupid) + 1, 0);
+            }
+            ++counts[groupid];
+        }
+        const double prob = std::exp(pitman_yor.score_counts(counts));
+        total_prob += prob;
+        distance += std::fabs(double(pair.second) / sample_count - prob);
+    }
+    distance += 1 - total_prob;  // mass of unsampled partitions
+    DIST_ASSERT(distance / 2 < 0.01, "total variation " << distance / 2);
+
+    // at a larger size, the mean table count matches the exact
+    // expectation, from E[K_{n+1}] = E[K_n] + (alpha + d E[K_n]) / (alpha + n)
+    const count_t large_size = 2000;
+    double expected = 0;
+    for (count_t n = 0; n < large_size; ++n) {
+        expected += (pitman_yor.alpha + pitman_yor.d * expected)
+                  / (pitman_yor.alpha + n);
+    }
+    const size_t large_sample_count = 400;
+    double sum = 0;
+    double sum_sq = 0;
+    for (size_t i = 0; i < large_sample_count; ++i) {
+        auto sample = pitman_yor.sample_assignments_tree(large_size, rng);
+        const double group_count =
+            *std::max_element(sample.begin(), sample.end()) + 1;
+        sum += group_count;
+        sum_sq += group_count * group_count;
+    }
+    const double mean = sum / large_sample_count;
+    const double standard_error = std::sqrt(
+        (sum_sq / large_sample_count - mean * mean) / large_sample_count);
+    DIST_ASSERT(
+        std::fabs(mean - expected) < 5 * standard_error,
+        "mean group count " << mean << ", expected " << expected);
+    DIST_ASSERT(
+        std::fabs(pitman_yor.expected_group_count(large_size) - expected)
+            < 0.2 * expected,
+        "bad asymptotic group count");
+}
+
+int main() {
+    rng_t rng;
+    test_fenwick_tree(rng);
+    test_sample_assignments_tree<int32_t>(rng);
+    test_sample_assignments_tree<uint64_t>(rng);
+
+    // sample sizes exceed 2^31 for 64-bit counts
+    test_clustering<int32_t>(int32_t(1) << 29);
+    test_clustering<uint32_t>(uint32_t(1) << 30);
+    test_clustering<int64_t>(int64_t(1) << 32);
+    test_clustering<uint64_t>(uint64_t(1) << 40);
+    return 0;
+}
@@ -0,0 +1,390 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <distributions/common.hpp>
+#include <distributions/assert_close.hpp>
+#include <distributions/random.hpp>
+#include <distributions/vector_math.hpp>
+#include <distributions/alias_table.hpp>
+#include <distributions/gibbs.hpp>
+#include <distributions/product_mixture.hpp>
+#include <distributions/models/dpd.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/models/niw.hpp>
+
+namespace distributions {
+typedef ProductModel<DirichletProcessDiscrete, NormalInverseChiSq> DpdNich;
+}  // namespace distributions
+
+using namespace distributions;  // NOLINT(*)
+
+// Every member must compile for values with no std::hash, and for
+// product models, whose groups are assembled by value.
+template class distributions::GibbsSampler<NormalInverseWishart<-1>>;
+template class distributions::GibbsSampler<DpdNich>;
+
+// Rebuilds the mixture from assignments and checks it matches the sampler.
+template<class Model>
+void assert_consistent(
+        const GibbsSampler<Model> & sampler,
+        const std::vector<typename Model::Value> & values,
+        rng_t & rng) {
+    typedef typename GibbsSampler<Model>::Id Id;
+    sampler.validate();
+
+    auto shared = Model::Shared::EXAMPLE();
+    const auto & counts = sampler.clustering().counts();
+    const size_t group_count = counts.size();
+    std::vector<int> expected_counts(group_count, 0);
+    typename Model::Mixture expected;
+    expected.init(shared, rng);
+    for (size_t groupid = 0; groupid < group_count; ++groupid) {
+        expected.add_group(shared, rng);
+    }
+    const auto & assignments = sampler.assignments();
+    for (size_t row = 0; row < assignments.size(); ++row) {
+        Id groupid = sampler.tracker().global_to_packed(assignments[row]);
+        ++expected_counts[groupid];
+        expected.add_value(shared, groupid, values[row], rng);
+    }
+    for (size_t groupid = 0; groupid < group_count; ++groupid) {
+        DIST_ASSERT_EQ(counts[groupid], expected_counts[groupid]);
+    }
+    DIST_ASSERT_CLOSE(
+        sampler.mixture().score_data(shared, rng),
+        expected.score_data(shared, rng));
+
+    VectorFloat actual_scores(group_count);
+    VectorFloat expected_scores(group_count);
+    for (size_t row = 0; row < values.size(); row += 50) {
+        vector_zero(group_count, actual_scores.data());
+        vector_zero(group_count, expected_scores.data());
+        sampler.mixture().score_value(shared, values[row], actual_scores, rng);
+        expected.score_value(shared, values[row], expected_scores, rng);
+        for (size_t groupid = 0; groupid < group_count; ++groupid) {
+            DIST_ASSERT_CLOSE(
+                actual_scores[groupid],
+                expected_scores[groupid]);
+        }
+    }
+}
+
+Clustering<int>::PitmanYor example_clustering() {
+    Clustering<int>::PitmanYor clustering;
+    clustering.alpha = 2.0;
+    clustering.d = 0.1;
+    return clustering;
+}
+
+// Samples each value from a fresh prior group.
+template<class Model>
+std::vector<typename Model::Value> sample_values(
+        const typename Model::Shared & shared,
+        size_t value_count,
+        rng_t & rng) {
+    std::vector<typename Model::Value> values;
+    for (size_t i = 0; i < value_count; ++i) {
+        typename Model::Group group;
+        group.init(shared, rng);
+        values.push_back(group.sample_value(shared, rng));
+    }
+    return values;
+}
+
+// Appends every partition of labels.size() rows, as restricted growth
+// strings: each row's label is at most one more than any earlier label.
+void enumerate_partitions(
+        std::vector<size_t> & labels,
+        size_t row,
+        size_t label_count,
+        std::vector<std::vector<size_t>> & partitions) {
+    if (row == labels.size()) {
+        partitions.push_back(labels);
+        return;
+    }
+    for (size_t label = 0; label <= label_count; ++label) {
+        labels[row] = label;
+        enumerate_partitions(
+            labels,
+            row + 1,
+            std::max(label_count, label + 1),
+            partitions);
+    }
+}
+
+// Relabels assignments in order of first appearance, so that equal
+// partitions have equal labels.
+template<class Id>
+std::vector<size_t> partition_labels(const std::vector<Id> & assignments) {
+    std::map<Id, size_t> labels;
+    std::vector<size_t> result;
+    for (const Id & id : assignments) {
+        const auto inserted = labels.insert(std::make_pair(id, labels.size()));
+        result.push_back(inserted.first->second);
+    }
+    return result;
+}
+
+// Runs step on a sampler of a few rows and checks that partitions are
+// visited in proportion to their exact posterior, found by enumeration.
+template<class Model, class Step>
+void assert_stationary(
+        const std::vector<typename Model::Value> & values,
+        size_t sample_count,
+        Step step) {
+    rng_t rng;
+    auto clustering = example_clustering();
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t row_count = values.size();
+
+    std::vector<std::vector<size_t>> partitions;
+    std::vector<size_t> labels(row_count);
+    enumerate_partitions(labels, 0, 0, partitions);
+    std::map<std::vector<size_t>, size_t> positions;
+    VectorFloat scores;
+    for (const auto & partition : partitions) {
+        const size_t group_count =
+            * std::max_element(partition.begin(), partition.end()) + 1;
+        std::vector<int> counts(group_count, 0);
+        std::vector<typename Model::Group> groups(group_count);
+        for (auto & group : groups) {
+            group.init(shared, rng);
+        }
+        for (size_t row = 0; row < row_count; ++row) {
+            ++counts[partition[row]];
+            groups[partition[row]].add_value(shared, values[row], rng);
+        }
+        float score = clustering.score_counts(counts);
+        for (const auto & group : groups) {
+            score += group.score_data(shared, rng);
+        }
+        positions[partition] = scores.size();
+        scores.push_back(score);
+    }
+    const float log_norm = log_sum_exp(scores);
+
+    GibbsSampler<Model> sampler(clustering, shared, values, rng, 2);
+    std::vector<size_t> counts(partitions.size(), 0);
+    for (size_t i = 0; i < sample_count; ++i) {
+        step(sampler, rng);
+        ++counts[positions[partition_labels(sampler.assignments())]];
+    }
+
+    float total_variation = 0;
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        const float expected = expf(scores[i] - log_norm);
+        const float actual = static_cast<float>(counts[i]) / sample_count;
+        total_variation += fabs(actual - expected) / 2;
+    }
+    DIST_ASSERT_LT(total_variation, 0.015);
+}
+
+template<class Model>
+void test_gibbs(size_t thread_count) {
+    rng_t rng;
+    auto clustering = example_clustering();
+    auto shared = Model::Shared::EXAMPLE();
+
+    const size_t row_count = 500;
+    auto values = sample_values<Model>(shared, row_count, rng);
+
+    GibbsSampler<Model> sampler(clustering, shared, values, rng, 2);
+    assert_consistent(sampler, values, rng);
+
+    sampler.sweep(rng);
+    assert_consistent(sampler, values, rng);
+
+    ThreadPool pool(thread_count);
+    for (size_t rows_per_barrier : {1, 7, 1000}) {
+        sampler.parallel_sweep(pool, rows_per_barrier, rng);
+        assert_consistent(sampler, values, rng);
+        DIST_ASSERT_LT(0, sampler.group_count());
+    }
+
+    // from one group, threads open new groups privately in one block
+    sampler.merge_all(rng);
+    sampler.parallel_sweep(pool, row_count, rng);
+    assert_consistent(sampler, values, rng);
+    DIST_ASSERT_LT(1, sampler.group_count());
+}
+
+template<class Model>
+void test_split_merge() {
+    rng_t rng;
+    auto clustering = example_clustering();
+    auto shared = Model::Shared::EXAMPLE();
+
+    auto values = sample_values<Model>(shared, 200, rng);
+
+    GibbsSampler<Model> sampler(clustering, shared, values, rng, 2);
+    size_t accepted_count = sampler.split_merge(100, 3, rng);
+    DIST_ASSERT_LT(0, accepted_count);
+    assert_consistent(sampler, values, rng);
+
+    sampler.merge_all(rng);
+    DIST_ASSERT_EQ(sampler.group_count(), 1);
+    assert_consistent(sampler, values, rng);
+    sampler.split_merge(100, 3, rng);
+    assert_consistent(sampler, values, rng);
+}
+
+void test_split_separated_clusters() {
+    typedef NormalInverseChiSq Model;
+    rng_t rng;
+    GibbsSampler<Model>::ClusteringModel clustering;
+    clustering.alpha = 1.0;
+    clustering.d = 0.0;
+    auto shared = Model::Shared::EXAMPLE();
+
+    std::vector<Model::Value> values;
+    for (size_t i = 0; i < 100; ++i) {
+        float mean = (i % 2) ? 10.f : -10.f;
+        values.push_back(mean + 0.1f * sample_std_normal(rng));
+    }
+
+    GibbsSampler<Model> sampler(clustering, shared, values, rng);
+    sampler.merge_all(rng);
+    DIST_ASSERT_EQ(sampler.group_count(), 1);
+    float merged_score = sampler.score_data(rng);
+    sampler.split_merge(50, 5, rng);
+    assert_consistent(sampler, values, rng);
+    DIST_ASSERT_LT(1, sampler.group_count());
+    DIST_ASSERT_LT(merged_score, sampler.score_data(rng));
+}
+
+// Acceptance uses only Group::score_data, which the exact posterior also
+// uses, so this holds even for features with approximate score_value.
+template<class Model>
+void test_split_merge_stationary() {
+    rng_t rng;
+    const auto values = sample_values<Model>(Model::Shared::EXAMPLE(), 5, rng);
+    assert_stationary<Model>(values, 1000000, [](
+            GibbsSampler<Model> & sampler,
+            rng_t & rng) {
+        sampler.split_merge(1, 2, rng);
+    });
+}
+
+template<class Model>
+void test_ingest() {
+    rng_t rng;
+    auto clustering = example_clustering();
+    auto shared = Model::Shared::EXAMPLE();
+
+    const auto values = sample_values<Model>(shared, 300, rng);
+    GibbsSampler<Model> sampler(clustering, shared, {}, rng);
+    for (size_t i = 0; i < values.size(); ++i) {
+        const size_t row = sampler.ingest(values[i], rng, i % 2);
+        DIST_ASSERT_EQ(row, i);
+        if (i % 50 == 49) {
+            sampler.resample_recent(20, rng);
+            assert_consistent(sampler, values, rng);
+        }
+    }
+    sampler.resample_recent(1000, rng);
+    assert_consistent(sampler, values, rng);
+}
+
+void test_alias_table() {
+    rng_t rng;
+    const float scores[] = {0.f, -1.f, -0.2f, -3.f, 0.5f, -0.7f};
+    const size_t size = sizeof(scores) / sizeof(float);
+    AliasTable table;
+    table.init(scores, size);
+    DIST_ASSERT_EQ(table.size(), size);
+
+    std::vector<float> probs(size, 0);
+    const size_t sample_count = 100000;
+    for (size_t i = 0; i < sample_count; ++i) {
+        probs[table.sample(rng)] += 1.f / sample_count;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const float expected = expf(table.score(i));
+        DIST_ASSERT_LT(fabs(probs[i] - expected), 0.01);
+    }
+}
+
+template<class Model>
+void test_mh_sweep() {
+    rng_t rng;
+    auto clustering = example_clustering();
+    auto shared = Model::Shared::EXAMPLE();
+
+    auto values = sample_values<Model>(shared, 500, rng);
+
+    GibbsSampler<Model> sampler(clustering, shared, values, rng, 2);
+    for (size_t rebuild_period : {1, 100}) {
+        sampler.mh_sweep(4, rebuild_period, rng);
+        assert_consistent(sampler, values, rng);
+        DIST_ASSERT_LT(0, sampler.group_count());
+    }
+}
+
+// DirichletProcessDiscrete values are integral, so feature proposals come
+// from tables, and are scored exactly.  Values repeat, so that each table
+// serves rows of several groups.  Sweeps rebuild tables before rows 0 and 3,
+// or only before row 0, and groups are removed and reopened in between.
+void test_mh_sweep_stationary() {
+    typedef DirichletProcessDiscrete Model;
+    for (size_t rebuild_period : {3, 7}) {
+        assert_stationary<Model>({0, 1, 0, 1, 2}, 500000, [=](
+                GibbsSampler<Model> & sampler,
+                rng_t & rng) {
+            sampler.mh_sweep(2, rebuild_period, rng);
+        });
+    }
+}
+
+int main() {
+    for (size_t thread_count : {1, 3}) {
+        test_gibbs<DirichletProcessDiscrete>(thread_count);
+        test_gibbs<NormalInverseChiSq>(thread_count);
+        test_gibbs<NormalInverseWishart<-1>>(thread_count);
+        test_gibbs<DpdNich>(thread_count);
+    }
+    test_split_merge<DirichletProcessDiscrete>();
+    test_split_merge<NormalInverseChiSq>();
+    test_split_merge<NormalInverseWishart<-1>>();
+    test_split_merge<DpdNich>();
+    test_split_merge_stationary<DirichletProcessDiscrete>();
+    test_split_merge_stationary<DpdNich>();
+    test_split_separated_clusters();
+    test_ingest<DirichletProcessDiscrete>();
+    test_ingest<NormalInverseChiSq>();
+    test_ingest<NormalInverseWishart<-1>>();
+    test_ingest<DpdNich>();
+    test_alias_table();
+    test_mh_sweep<DirichletProcessDiscrete>();
+    test_mh_sweep<NormalInverseChiSq>();
+    test_mh_sweep<NormalInverseWishart<-1>>();
+    test_mh_sweep<DpdNich>();
+    test_mh_sweep_stationary();
+    return 0;
+}
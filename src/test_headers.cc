@@ -1,8 +1,11 @@
+#include <distributions/alias_table.hpp>
 #include <distributions/aligned_allocator.hpp>
 #include <distributions/assert_close.hpp>
 #include <distributions/clustering.hpp>
 #include <distributions/common.hpp>
 #include <distributions/cython.hpp>
+#include <distributions/fenwick.hpp>
+#include <distributions/gibbs.hpp>
 #include <distributions/mixins.hpp>
 #include <distributions/mixture.hpp>
 #include <distributions/models/bb.hpp>
@@ -12,10 +15,14 @@
 #include <distributions/models/gp.hpp>
 #include <distributions/models/nich.hpp>
 #include <distributions/models/niw.hpp>
+#include <distributions/parallel_sampler.hpp>
+#include <distributions/product_mixture.hpp>
 #include <distributions/random_fwd.hpp>
 #include <distributions/random.hpp>
+#include <distributions/scratch.hpp>
 #include <distributions/sparse.hpp>
 #include <distributions/special.hpp>
+#include <distributions/thread_pool.hpp>
 #include <distributions/timers.hpp>
 #include <distributions/trivial_hash.hpp>
 #include <distributions/vector.hpp>
@@ -0,0 +1,1002 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <distributions/common.hpp>
+#include <distributions/assert_close.hpp>
+#include <distributions/random.hpp>
+#include <distributions/parallel_sampler.hpp>
+#include <distributions/product_mixture.hpp>
+
+#include <distributions/models/bb.hpp>
+#include <distributions/models/bnb.hpp>
+#include <distributions/models/dd.hpp>
+#include <distributions/models/dpd.hpp>
+#include <distributions/models/gp.hpp>
+#include <distributions/models/nich.hpp>
+#include <distributions/models/niw.hpp>
+
+namespace distributions {
+typedef DirichletDiscrete<16> DirichletDiscrete16;
+typedef NormalInverseWishart<-1> NormalInverseWishartV;
+}  // namespace distributions
+
+#define DIST_MODELS(x) \
+    x(BetaBernoulli) \
+    x(BetaNegativeBinomial) \
+    x(DirichletDiscrete16) \
+    x(DirichletProcessDiscrete) \
+    x(GammaPoisson) \
+    x(NormalInverseChiSq) \
+    x(NormalInverseWishartV)
+
+using namespace distributions;  // NOLINT(*)
+
+template <typename Mixture>
+void assert_same_scores(
+        const typename Mixture::Shared & shared,
+        const Mixture & expected,
+        const Mixture & actual,
+        const typename Mixture::Value * values,
+        size_t value_count,
+        rng_t & rng) {
+    const size_t group_count = expected.groups().size();
+    DIST_ASSERT_EQ(actual.groups().size(), group_count);
+    VectorFloat expected_scores(group_count);
+    VectorFloat actual_scores(group_count);
+    for (size_t v = 0; v < value_count; ++v) {
+        const auto & value = values[v];
+        std::fill(expected_scores.begin(), expected_scores.end(), 0);
+        std::fill(actual_scores.begin(), actual_scores.end(), 0);
+        expected.score_value(shared, value, expected_scores, rng);
+        for (size_t i = 0; i < group_count; ++i) {
+            float actual_score =
+                actual.score_value_group(shared, i, value, rng);
+            DIST_ASSERT_CLOSE(actual_score, expected_scores[i]);
+        }
+        actual.score_value(shared, value, actual_scores, rng);
+        for (size_t i = 0; i < group_count; ++i) {
+            DIST_ASSERT_CLOSE(actual_scores[i], expected_scores[i]);
+        }
+    }
+    actual.validate(shared);
+}
+
+// Initializes a mixture of group_count empty groups.
+template <typename Mixture>
+void init_mixture(
+        const typename Mixture::Shared & shared,
+        Mixture & mixture,
+        size_t group_count,
+        rng_t & rng) {
+    mixture.groups().resize(group_count);
+    for (auto & group : mixture.groups()) {
+        group.init(shared, rng);
+    }
+    mixture.init(shared, rng);
+}
+
+// Samples value_count values from the prior, adding each to shared.
+// Values are returned in an array, avoiding std::vector<bool>, which is
+// not contiguous.
+template <typename Model>
+std::unique_ptr<typename Model::Value[]> make_values(
+        typename Model::Shared & shared,
+        size_t value_count,
+        rng_t & rng) {
+    typedef typename Model::Value Value;
+    typename Model::Group prior;
+    prior.init(shared, rng);
+    std::unique_ptr<Value[]> values(new Value[value_count]);
+    for (size_t i = 0; i < value_count; ++i) {
+        values[i] = prior.sample_value(shared, rng);
+        shared.add_value(values[i], rng);
+    }
+    return values;
+}
+
+// Assigns value i to group i % group_count.
+std::vector<size_t> make_groupids(size_t value_count, size_t group_count) {
+    std::vector<size_t> groupids;
+    for (size_t i = 0; i < value_count; ++i) {
+        groupids.push_back(i % group_count);
+    }
+    return groupids;
+}
+
+template <typename Model>
+void test_batched_updates() {
+    typedef typename Model::Mixture Mixture;
+
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t group_count = 5;
+    const size_t value_count = 200;
+    auto values = make_values<Model>(shared, value_count, rng);
+    auto groupids = make_groupids(value_count, group_count);
+
+    Mixture sequential;
+    Mixture batched;
+    init_mixture(shared, sequential, group_count, rng);
+    init_mixture(shared, batched, group_count, rng);
+
+    for (size_t i = 0; i < value_count; ++i) {
+        sequential.add_value(shared, groupids[i], values[i], rng);
+    }
+    batched.add_values(shared, value_count, &groupids[0], values.get(), rng);
+    assert_same_scores(
+        shared,
+        sequential,
+        batched,
+        values.get(),
+        value_count,
+        rng);
+
+    const size_t remove_count = value_count / 2;
+    for (size_t i = 0; i < remove_count; ++i) {
+        sequential.remove_value(shared, groupids[i], values[i], rng);
+    }
+    batched.remove_values(
+        shared,
+        remove_count,
+        &groupids[0],
+        values.get(),
+        rng);
+    assert_same_scores(
+        shared,
+        sequential,
+        batched,
+        values.get(),
+        value_count,
+        rng);
+}
+
+template <typename Model>
+void test_lazy_updates() {
+    typedef typename Model::Mixture Mixture;
+
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t group_count = 5;
+    const size_t value_count = 200;
+    auto values = make_values<Model>(shared, value_count, rng);
+    auto groupids = make_groupids(value_count, group_count);
+
+    Mixture eager;
+    Mixture lazy;
+    init_mixture(shared, eager, group_count, rng);
+    init_mixture(shared, lazy, group_count, rng);
+    lazy.set_lazy(true);
+
+    for (size_t i = 0; i < value_count; ++i) {
+        eager.add_value(shared, groupids[i], values[i], rng);
+        lazy.add_value(shared, groupids[i], values[i], rng);
+        if (i % 37 == 0) {
+            assert_same_scores(shared, eager, lazy, values.get(), i, rng);
+        }
+    }
+
+    // leave the last group dirty while removing the first group,
+    // so that its dirty flag must follow it to the first position
+    const size_t last = group_count - 1;
+    for (size_t i = 0; i < value_count; ++i) {
+        if (groupids[i] == 0 or (groupids[i] == last and i % 2)) {
+            eager.remove_value(shared, groupids[i], values[i], rng);
+            lazy.remove_value(shared, groupids[i], values[i], rng);
+        }
+    }
+    eager.remove_group(shared, 0);
+    lazy.remove_group(shared, 0);
+    assert_same_scores(
+        shared,
+        eager,
+        lazy,
+        values.get(),
+        value_count,
+        rng);
+}
+
+template <typename Model>
+void test_tracked_score() {
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t group_count = 5;
+    const size_t value_count = 200;
+    auto values = make_values<Model>(shared, value_count, rng);
+    auto groupids = make_groupids(value_count, group_count);
+
+    typename Model::Mixture mixture;
+    init_mixture(shared, mixture, group_count, rng);
+    mixture.set_track_score(shared, true, rng);
+
+    const size_t half = value_count / 2;
+    for (size_t i = 0; i < half; ++i) {
+        mixture.add_value(shared, groupids[i], values[i], rng);
+    }
+    mixture.add_values(
+        shared,
+        value_count - half,
+        groupids.data() + half,
+        values.get() + half,
+        rng);
+    mixture.validate(shared);
+    DIST_ASSERT_CLOSE(
+        mixture.tracked_score_data(),
+        mixture.score_data(shared, rng));
+
+    for (size_t i = 0; i < value_count; ++i) {
+        if (groupids[i] == 0) {
+            mixture.remove_value(shared, groupids[i], values[i], rng);
+        }
+    }
+    mixture.remove_group(shared, 0);
+    mixture.add_group(shared, rng);
+    mixture.validate(shared);
+    DIST_ASSERT_CLOSE(
+        mixture.tracked_score_data(),
+        mixture.score_data(shared, rng));
+}
+
+template <typename Model>
+void test_score_value_range() {
+    typedef typename Model::Mixture Mixture;
+
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t group_count = 100;
+    const size_t chunk_size = 16;
+
+    Mixture mixture;
+    mixture.groups().resize(group_count);
+    for (auto & group : mixture.groups()) {
+        group.init(shared, rng);
+        for (size_t i = 0; i < 3; ++i) {
+            group.add_value(shared, group.sample_value(shared, rng), rng);
+        }
+    }
+    mixture.init(shared, rng);
+
+    typename Model::Group prior;
+    prior.init(shared, rng);
+    VectorFloat expected(group_count);
+    VectorFloat actual(group_count);
+    for (size_t trial = 0; trial < 10; ++trial) {
+        auto value = prior.sample_value(shared, rng);
+        std::fill(expected.begin(), expected.end(), 0);
+        std::fill(actual.begin(), actual.end(), 0);
+        mixture.score_value(shared, value, expected, rng);
+        for (size_t begin = 0; begin < group_count; begin += chunk_size) {
+            size_t size = std::min(chunk_size, group_count - begin);
+            AlignedFloats chunk(actual.data() + begin, size);
+            mixture.score_value_range(shared, value, begin, chunk, rng);
+        }
+        for (size_t i = 0; i < group_count; ++i) {
+            DIST_ASSERT_CLOSE(actual[i], expected[i]);
+        }
+    }
+}
+
+// Values below small_value_limit take a product-form fast path in
+// score_value; check both sides of the limit against Group::score_value,
+// including the boundary pair small_value_limit - 1 and small_value_limit.
+template <typename Model>
+void test_small_value_scores() {
+    typedef typename Model::Mixture Mixture;
+    typedef typename Model::Value Value;
+    const Value small_value_limit =
+        Model::MixtureValueScorer::small_value_limit;
+
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t group_count = 10;
+
+    // group sizes 0, 2, 4, ... so that posteriors differ across groups
+    Mixture mixture;
+    mixture.groups().resize(group_count);
+    for (size_t i = 0; i < group_count; ++i) {
+        auto & group = mixture.groups(i);
+        group.init(shared, rng);
+        for (size_t j = 0; j < 2 * i; ++j) {
+            group.add_value(shared, j % (small_value_limit + 2), rng);
+        }
+    }
+    mixture.init(shared, rng);
+
+    VectorFloat scores(group_count);
+    for (Value value = 0; value <= small_value_limit + 1; ++value) {
+        std::fill(scores.begin(), scores.end(), 0);
+        mixture.score_value(shared, value, scores, rng);
+        for (size_t i = 0; i < group_count; ++i) {
+            const float expected =
+                mixture.groups(i).score_value(shared, value, rng);
+            const float tol = 1e-3f * (1 + fabs(expected));
+            DIST_ASSERT_LT(fabs(scores[i] - expected), tol);
+            const float group_score =
+                mixture.score_value_group(shared, i, value, rng);
+            DIST_ASSERT_LT(fabs(group_score - expected), tol);
+        }
+    }
+}
+
+template <typename Model>
+void test_score_data_grid(
+        const std::vector<typename Model::Shared> & shareds) {
+    typedef typename Model::Mixture Mixture;
+
+    rng_t rng;
+    const auto & shared = shareds[0];
+    Mixture mixture;
+    mixture.groups().resize(10);
+    for (auto & group : mixture.groups()) {
+        group.init(shared, rng);
+        for (size_t i = 0; i < 5; ++i) {
+            group.add_value(shared, group.sample_value(shared, rng), rng);
+        }
+    }
+    mixture.init(shared, rng);
+
+    // a scorer that no mixture maintains scores groups directly
+    typename Model::MixtureDataScorer unmaintained;
+
+    const size_t size = shareds.size();
+    VectorFloat serial(size);
+    VectorFloat parallel(size);
+    ThreadPool pool(3);
+    mixture.score_data_grid(shareds, serial, rng);
+    mixture.score_data_grid(shareds, parallel, rng, pool);
+    for (size_t i = 0; i < size; ++i) {
+        float expected = 0;
+        for (const auto & group : mixture.groups()) {
+            expected += group.score_data(shareds[i], rng);
+        }
+        const float tol = 1e-3f * (1 + fabs(expected));
+        DIST_ASSERT_LT(fabs(serial[i] - expected), tol);
+        DIST_ASSERT_LT(fabs(parallel[i] - expected), tol);
+        DIST_ASSERT_LT(
+            fabs(mixture.score_data(shareds[i], rng) - expected),
+            tol);
+        DIST_ASSERT_LT(
+            fabs(unmaintained.score_data(shareds[i], mixture.groups(), rng)
+                - expected),
+            tol);
+    }
+}
+
+// Sets shared to the i-th point of a hyperparameter grid.  Models with
+// dedicated grid tests keep the example point.
+template <typename Shared>
+void set_grid_point(Shared &, size_t) {}
+
+void set_grid_point(BetaBernoulli::Shared & shared, size_t i) {
+    shared.alpha = 0.5f + 0.25f * (i % 5);
+    shared.beta = 2.f - 0.3f * (i % 3);
+}
+
+void set_grid_point(BetaNegativeBinomial::Shared & shared, size_t i) {
+    shared.alpha = 1.f + 0.5f * (i % 4);
+    shared.beta = 1.f + 0.3f * (i % 3);
+    shared.r = 1 + i % 3;
+}
+
+void set_grid_point(DirichletProcessDiscrete::Shared & shared, size_t i) {
+    shared.alpha = 0.5f + 0.2f * (i % 5);
+}
+
+void set_grid_point(GammaPoisson::Shared & shared, size_t i) {
+    shared.alpha = 1.f + 0.5f * (i % 4);
+    shared.inv_beta = 0.5f + 0.25f * (i % 5);
+}
+
+void set_grid_point(NormalInverseChiSq::Shared & shared, size_t i) {
+    shared.mu = 0.1f * i - 1.f;
+    shared.kappa = 1.f + 0.2f * (i % 3);
+    shared.sigmasq = 0.5f + 0.25f * (i % 4);
+    shared.nu = 1.f + 0.5f * (i % 5);
+}
+
+template <typename Model>
+void test_score_data_grid() {
+    std::vector<typename Model::Shared> shareds;
+    for (size_t i = 0; i < 20; ++i) {
+        auto shared = Model::Shared::EXAMPLE();
+        set_grid_point(shared, i);
+        shareds.push_back(shared);
+    }
+    test_score_data_grid<Model>(shareds);
+}
+
+void test_dd_score_data_grid() {
+    // neighboring points differ in one alpha, exercising incremental updates
+    std::vector<DirichletDiscrete16::Shared> shareds;
+    auto shared = DirichletDiscrete16::Shared::EXAMPLE();
+    for (size_t i = 0; i < 50; ++i) {
+        shared.alphas[i % shared.dim] = 0.1f + 0.2f * (i % 7);
+        shareds.push_back(shared);
+    }
+    test_score_data_grid<DirichletDiscrete16>(shareds);
+}
+
+void test_niw_posterior_cache() {
+    typedef NormalInverseWishartV Model;
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    Model::Group group;
+    group.init(shared, rng);
+    std::vector<Model::Value> values;
+
+    // many adds and removes, crossing several refresh periods
+    for (size_t step = 0; step < 500; ++step) {
+        if (values.empty() or step % 3) {
+            values.push_back(group.sample_value(shared, rng));
+            group.add_value(shared, values.back(), rng);
+        } else {
+            size_t i = sample_int(rng, 0, values.size() - 1);
+            std::swap(values[i], values.back());
+            group.remove_value(shared, values.back(), rng);
+            values.pop_back();
+        }
+        const auto & cached = group.get_posterior(shared);
+        const Model::Shared post = shared.plus_group(group);
+        Eigen::LLT<Model::Matrix> fresh(post.psi);
+        DIST_ASSERT(
+            cached.psi_llt.matrixL().toDenseMatrix().isApprox(
+                fresh.matrixL().toDenseMatrix(), 1e-3f),
+            "cached factor differs from a fresh LLT");
+        DIST_ASSERT(cached.mu.isApprox(post.mu, 1e-3f), "bad posterior mu");
+        DIST_ASSERT_CLOSE(cached.kappa, post.kappa);
+        DIST_ASSERT_CLOSE(
+            cached.psi_log_det,
+            fast_log(post.psi.determinant()));
+    }
+
+    // editing the shared, or a copy of it, invalidates the cache
+    shared.psi *= 2.f;
+    const Model::Shared post = shared.plus_group(group);
+    DIST_ASSERT_CLOSE(
+        group.get_posterior(shared).psi_log_det,
+        fast_log(post.psi.determinant()));
+
+    Model::Group::Posterior temp;
+    Model::Shared moved = shared;
+    moved.mu(0) += 1.f;
+    const Model::Shared moved_post = moved.plus_group(group);
+    DIST_ASSERT(
+        group.peek_posterior(moved, temp).mu.isApprox(moved_post.mu, 1e-3f),
+        "stale posterior mu");
+    Model::Shared sheared = shared;
+    sheared.psi(0, 1) = sheared.psi(1, 0) = 0.5f;
+    const Model::Shared sheared_post = sheared.plus_group(group);
+    const float sheared_log_det = fast_log(sheared_post.psi.determinant());
+    DIST_ASSERT_LT(
+        fabs(group.peek_posterior(sheared, temp).psi_log_det
+            - sheared_log_det),
+        1e-3f * (1 + fabs(sheared_log_det)));
+}
+
+// Compares cached scores across a grid of shareds with those of groups
+// whose caches have been dropped.
+void test_niw_score_data_grid(
+        const std::vector<NormalInverseWishartV::Shared> & shareds) {
+    typedef NormalInverseWishartV Model;
+    test_score_data_grid<Model>(shareds);
+
+    rng_t rng;
+    Model::Mixture mixture;
+    mixture.groups().resize(10);
+    for (auto & group : mixture.groups()) {
+        group.init(shareds[0], rng);
+        for (size_t i = 0; i < 5; ++i) {
+            auto value = group.sample_value(shareds[0], rng);
+            group.add_value(shareds[0], value, rng);
+        }
+    }
+    mixture.init(shareds[0], rng);
+    const Model::Value value = Model::Value::Ones(shareds[0].dim());
+    VectorFloat scores(shareds.size());
+    mixture.score_data_grid(shareds, scores, rng);
+    for (size_t i = 0; i < shareds.size(); ++i) {
+        float expected = 0;
+        for (const auto & group : mixture.groups()) {
+            Model::Group fresh = group;
+            fresh.touch();
+            expected += fresh.score_data(shareds[i], rng);
+            const float expected_value =
+                fresh.score_value(shareds[i], value, rng);
+            const float actual_value =
+                group.score_value(shareds[i], value, rng);
+            DIST_ASSERT_LT(
+                fabs(actual_value - expected_value),
+                1e-3f * (1 + fabs(expected_value)));
+        }
+        DIST_ASSERT_LT(fabs(scores[i] - expected), 1e-3f * fabs(expected));
+    }
+}
+
+void test_niw_score_data_grid() {
+    // grid points are copies edited in place
+    typedef NormalInverseWishartV Model;
+    std::vector<Model::Shared> shareds;
+    auto shared = Model::Shared::EXAMPLE();
+    const size_t dim = shared.dim();
+    for (size_t i = 0; i < 20; ++i) {
+        shared.mu(i % dim) = 0.1f * i;
+        shared.psi(i % dim, i % dim) = 1.f + 0.2f * (i % 5);
+        shared.psi(0, 1) = shared.psi(1, 0) = 0.1f * (i % 7) - 0.3f;
+        shared.kappa = 1.f + 0.1f * (i % 3);
+        shareds.push_back(shared);
+    }
+    test_niw_score_data_grid(shareds);
+
+    // only an off-diagonal entry of psi varies
+    shareds.clear();
+    shared = Model::Shared::EXAMPLE();
+    for (size_t i = 0; i < 4; ++i) {
+        shared.psi(0, 1) = shared.psi(1, 0) = 0.2f * i;
+        shareds.push_back(shared);
+    }
+    test_niw_score_data_grid(shareds);
+}
+
+// The baseline NIW scores: a multivariate Student-t on plus_group for
+// values, and the determinant form on plus_group for data.
+float niw_score_value_reference(
+        const NormalInverseWishartV::Shared & shared,
+        const NormalInverseWishartV::Group & group,
+        const NormalInverseWishartV::Value & value) {
+    typedef NormalInverseWishartV Model;
+    const Model::Shared post = shared.plus_group(group);
+    const float dof = post.nu - static_cast<float>(shared.dim()) + 1.f;
+    const Model::Matrix sigma =
+        post.psi * (post.kappa + 1.f) / (post.kappa * dof);
+    return score_mv_student_t(value, dof, post.mu, sigma);
+}
+
+float niw_score_data_reference(
+        const NormalInverseWishartV::Shared & shared,
+        const NormalInverseWishartV::Group & group) {
+    typedef NormalInverseWishartV Model;
+    const Model::Shared post = shared.plus_group(group);
+    const float log_pi = 1.1447298858494002;
+    return lmultigamma(shared.dim(), post.nu * 0.5)
+        + shared.nu * 0.5 * fast_log(shared.psi.determinant())
+        - static_cast<float>(group.count * shared.dim()) * 0.5 * log_pi
+        - lmultigamma(shared.dim(), shared.nu * 0.5)
+        - post.nu * 0.5 * fast_log(post.psi.determinant())
+        + static_cast<float>(shared.dim())
+          * 0.5 * fast_log(shared.kappa / post.kappa);
+}
+
+// Checks every NIW scoring path against the baseline forms, with a
+// non-diagonal prior and groups that have seen many removes.
+void test_niw_ground_truth() {
+    typedef NormalInverseWishartV Model;
+    rng_t rng;
+    auto shared = Model::Shared::EXAMPLE();
+    shared.mu << 0.5f, -1.f, 0.25f;
+    shared.kappa = 2.f;
+    shared.nu = 6.f;
+    shared.psi <<
+        2.f, 0.6f, -0.3f,
+        0.6f, 1.5f, 0.4f,
+        -0.3f, 0.4f, 1.f;
+    const size_t group_count = 20;
+    const size_t chunk_size = 8;
+
+    Model::Group prior;
+    prior.init(shared, rng);
+    for (bool lazy : {false, true}) {
+        Model::Mixture mixture;
+        mixture.groups().resize(group_count);
+        for (auto & group : mixture.groups()) {
+            group.init(shared, rng);
+        }
+        mixture.init(shared, rng);
+        mixture.set_lazy(lazy);
+
+        // one remove per two adds, then empty group 0 entirely
+        std::vector<std::vector<Model::Value>> values(group_count);
+        for (size_t step = 0; step < 3000; ++step) {
+            const size_t groupid = sample_int(rng, 0, group_count - 1);
+            auto & group_values = values[groupid];
+            if (group_values.empty() or step % 3) {
+                group_values.push_back(prior.sample_value(shared, rng));
+                mixture.add_value(shared, groupid, group_values.back(), rng);
+            } else {
+                size_t i = sample_int(rng, 0, group_values.size() - 1);
+                std::swap(group_values[i], group_values.back());
+                mixture.remove_value(
+                    shared,
+                    groupid,
+                    group_values.back(),
+                    rng);
+                group_values.pop_back();
+            }
+        }
+        while (not values[0].empty()) {
+            mixture.remove_value(shared, 0, values[0].back(), rng);
+            values[0].pop_back();
+        }
+
+        float expected_data = 0;
+        for (const auto & group : mixture.groups()) {
+            const float expected = niw_score_data_reference(shared, group);
+            const float actual = group.score_data(shared, rng);
+            DIST_ASSERT_LT(
+                fabs(actual - expected),
+                1e-3f * (1 + fabs(expected)));
+            expected_data += expected;
+        }
+        const float actual_data = mixture.score_data(shared, rng);
+        DIST_ASSERT_LT(
+            fabs(actual_data - expected_data),
+            1e-3f * (1 + fabs(expected_data)));
+
+        VectorFloat scores(group_count);
+        VectorFloat chunked(group_count);
+        for (size_t trial = 0; trial < 10; ++trial) {
+            const Model::Value value = prior.sample_value(shared, rng);
+            std::fill(scores.begin(), scores.end(), 0);
+            std::fill(chunked.begin(), chunked.end(), 0);
+            mixture.score_value(shared, value, scores, rng);
+            mixture.flush(shared, rng);
+            for (size_t begin = 0; begin < group_count; begin += chunk_size) {
+                const size_t size = std::min(chunk_size, group_count - begin);
+                AlignedFloats chunk(chunked.data() + begin, size);
+                mixture.score_value_range(shared, value, begin, chunk, rng);
+            }
+            for (size_t i = 0; i < group_count; ++i) {
+                const auto & group = mixture.groups(i);
+                const float expected =
+                    niw_score_value_reference(shared, group, value);
+                const float tol = 1e-3f * (1 + fabs(expected));
+                Model::Scorer scorer;
+                scorer.init(shared, group, rng);
+                DIST_ASSERT_LT(
+                    fabs(scorer.eval(shared, value, rng) - expected),
+                    tol);
+                DIST_ASSERT_LT(
+                    fabs(group.score_value(shared, value, rng) - expected),
+                    tol);
+                DIST_ASSERT_LT(fabs(scores[i] - expected), tol);
+                DIST_ASSERT_LT(fabs(chunked[i] - expected), tol);
+                const float group_score =
+                    mixture.score_value_group(shared, i, value, rng);
+                DIST_ASSERT_LT(fabs(group_score - expected), tol);
+            }
+        }
+    }
+}
+
+// Old groups survive while new ones churn, as under a Pitman-Yor prior.
+// Lookups must stay exact and the table must stay O(packed_size).
+void test_id_tracker_churn() {
+    typedef MixtureIdTracker::Id Id;
+    rng_t rng;
+    MixtureIdTracker tracker;
+    const size_t survivor_count = 5;
+    tracker.init(survivor_count);
+    std::vector<Id> removed;
+    for (size_t step = 0; step < 100000; ++step) {
+        const size_t packed_size = tracker.packed_size();
+        if (packed_size < survivor_count + 10 or sample_bernoulli(rng, 0.5)) {
+            tracker.add_group();
+        } else {
+            // packed ids of survivors move, so pick by global id
+            Id packed = sample_int(rng, 0, packed_size - 1);
+            if (tracker.packed_to_global(packed) >= survivor_count) {
+                removed.push_back(tracker.packed_to_global(packed));
+                tracker.remove_group(packed);
+            }
+        }
+        DIST_ASSERT_LE(
+            tracker.table_size(),
+            5 * tracker.packed_size() + 64);
+        if (step % 1000 == 0) {
+            for (Id packed = 0; packed < tracker.packed_size(); ++packed) {
+                Id global = tracker.packed_to_global(packed);
+                DIST_ASSERT_EQ(tracker.global_to_packed(global), packed);
+            }
+            for (Id global = 0; global < survivor_count; ++global) {
+                DIST_ASSERT(tracker.contains_global(global), "lost id");
+            }
+            for (Id global : removed) {
+                DIST_ASSERT(not tracker.contains_global(global), "stale id");
+            }
+            removed.clear();
+        }
+    }
+}
+
+void test_parallel_sampler() {
+    rng_t rng;
+    ThreadPool pool(4);
+    ParallelGroupSampler sampler(pool, 16);
+    const size_t group_count = 1000;
+    VectorFloat scores;
+
+    // a single dominant group must be found in whichever chunk it lies
+    for (size_t expected = 0; expected < group_count; expected += 97) {
+        size_t actual = sampler.sample(rng, group_count, scores,
+            [&](size_t begin, AlignedFloats chunk, rng_t &) {
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    chunk[i] += (begin + i == expected) ? 0.f : -100.f;
+                }
+            });
+        DIST_ASSERT_EQ(actual, expected);
+    }
+    DIST_ASSERT_LT(1, sampler.chunk_count());
+
+    // two equally likely groups in different chunks
+    const size_t sample_count = 2000;
+    size_t low_count = 0;
+    for (size_t i = 0; i < sample_count; ++i) {
+        size_t sample = sampler.sample(rng, group_count, scores,
+            [&](size_t begin, AlignedFloats chunk, rng_t &) {
+                for (size_t j = 0; j < chunk.size(); ++j) {
+                    size_t groupid = begin + j;
+                    bool likely = (groupid == 10 or groupid == 990);
+                    chunk[j] += likely ? 0.f : -100.f;
+                }
+            });
+        DIST_ASSERT(sample == 10 or sample == 990, "bad sample: " << sample);
+        low_count += (sample == 10);
+    }
+    DIST_ASSERT_LT(sample_count * 4 / 10, low_count);
+    DIST_ASSERT_LT(low_count, sample_count * 6 / 10);
+
+    // trailing chunks whose likelihoods underflow are never sampled
+    const size_t tail_begin = group_count / 2;
+    for (size_t i = 0; i < sample_count; ++i) {
+        size_t sample = sampler.sample(rng, group_count, scores,
+            [&](size_t begin, AlignedFloats chunk, rng_t &) {
+                for (size_t j = 0; j < chunk.size(); ++j) {
+                    chunk[j] += (begin + j < tail_begin) ? 0.f : -200.f;
+                }
+            });
+        DIST_ASSERT_LT(sample, tail_begin);
+    }
+}
+
+void test_product_mixture() {
+    typedef ProductMixture<int, BetaBernoulli, NormalInverseChiSq> Product;
+    typedef Clustering<int>::PitmanYor::Mixture ClusteringMixture;
+
+    rng_t rng;
+    Product::Model model;
+    model.clustering.alpha = 2.0;
+    model.clustering.d = 0.1;
+    auto & bb_shared = std::get<0>(model.features);
+    auto & nich_shared = std::get<1>(model.features);
+    bb_shared = BetaBernoulli::Shared::EXAMPLE();
+    nich_shared = NormalInverseChiSq::Shared::EXAMPLE();
+
+    Product product;
+    product.init(model, rng, 2);
+
+    // a hand-coordinated reference
+    ClusteringMixture clustering;
+    clustering.counts().assign(2, 0);
+    clustering.init(model.clustering);
+    BetaBernoulli::Mixture bb;
+    NormalInverseChiSq::Mixture nich;
+    bb.groups().resize(2);
+    nich.groups().resize(2);
+    for (auto & group : bb.groups()) { group.init(bb_shared, rng); }
+    for (auto & group : nich.groups()) { group.init(nich_shared, rng); }
+    bb.init(bb_shared, rng);
+    nich.init(nich_shared, rng);
+
+    std::vector<Product::Row> rows;
+    std::vector<size_t> groupids;
+    for (size_t i = 0; i < 100; ++i) {
+        Product::Row row(sample_bernoulli(rng, 0.3), sample_std_normal(rng));
+        size_t groupid = product.sample_row(model, row, rng);
+        bool added = product.add_row(model, groupid, row, rng);
+        DIST_ASSERT_EQ(clustering.add_value(model.clustering, groupid), added);
+        bb.add_value(bb_shared, groupid, std::get<0>(row), rng);
+        nich.add_value(nich_shared, groupid, std::get<1>(row), rng);
+        if (added) {
+            bb.add_group(bb_shared, rng);
+            nich.add_group(nich_shared, rng);
+        }
+        rows.push_back(row);
+        groupids.push_back(groupid);
+    }
+    product.validate(model);
+
+    // remove rows in order; packed ids of removed groups are reused
+    for (size_t i = 0; i < 50; ++i) {
+        size_t groupid = groupids[i];
+        const auto & row = rows[i];
+        bool removed = product.remove_row(model, groupid, row, rng);
+        DIST_ASSERT_EQ(
+            clustering.remove_value(model.clustering, groupid),
+            removed);
+        bb.remove_value(bb_shared, groupid, std::get<0>(row), rng);
+        nich.remove_value(nich_shared, groupid, std::get<1>(row), rng);
+        if (removed) {
+            bb.remove_group(bb_shared, groupid);
+            nich.remove_group(nich_shared, groupid);
+            for (size_t & other : groupids) {
+                if (other == clustering.counts().size()) {
+                    other = groupid;
+                }
+            }
+        }
+    }
+    product.validate(model);
+
+    const size_t group_count = product.size();
+    DIST_ASSERT_EQ(clustering.counts().size(), group_count);
+    VectorFloat expected(group_count);
+    for (const auto & row : rows) {
+        clustering.score_value(model.clustering, expected);
+        bb.score_value(bb_shared, std::get<0>(row), expected, rng);
+        nich.score_value(nich_shared, std::get<1>(row), expected, rng);
+        const VectorFloat & actual = product.score_row(model, row, rng);
+        for (size_t i = 0; i < group_count; ++i) {
+            DIST_ASSERT_CLOSE(actual[i], expected[i]);
+        }
+    }
+    float expected_score = clustering.score_data(model.clustering)
+                         + bb.score_data(bb_shared, rng)
+                         + nich.score_data(nich_shared, rng);
+    DIST_ASSERT_CLOSE(product.score_data(model, rng), expected_score);
+}
+
+void test_product_ingest() {
+    typedef ProductMixture<int, BetaBernoulli, NormalInverseChiSq> Product;
+
+    rng_t rng;
+    Product::Model model;
+    model.clustering.alpha = 2.0;
+    model.clustering.d = 0.1;
+    std::get<0>(model.features) = BetaBernoulli::Shared::EXAMPLE();
+    std::get<1>(model.features) = NormalInverseChiSq::Shared::EXAMPLE();
+
+    Product streamed;
+    streamed.init(model, rng);
+    Product expected;
+    expected.init(model, rng);
+
+    // batches of rows, alternating sampled and MAP assignment
+    const size_t batch_size = 17;
+    std::vector<Product::Row> rows(batch_size);
+    std::vector<size_t> groupids(batch_size);
+    for (size_t batch = 0; batch < 12; ++batch) {
+        for (auto & row : rows) {
+            row = Product::Row(
+                sample_bernoulli(rng, 0.3),
+                sample_std_normal(rng));
+        }
+        streamed.ingest_rows(
+            model,
+            batch_size,
+            rows.data(),
+            groupids.data(),
+            rng,
+            batch % 2);
+        for (size_t i = 0; i < batch_size; ++i) {
+            DIST_ASSERT_LT(groupids[i], streamed.size());
+            expected.add_row(model, groupids[i], rows[i], rng);
+        }
+        streamed.validate(model);
+    }
+
+    DIST_ASSERT_EQ(streamed.size(), expected.size());
+    DIST_ASSERT_EQ(
+        streamed.clustering().sample_size(),
+        12 * batch_size);
+    DIST_ASSERT_CLOSE(
+        streamed.score_data(model, rng),
+        expected.score_data(model, rng));
+    for (const auto & row : rows) {
+        const VectorFloat actual = streamed.score_row(model, row, rng);
+        const VectorFloat & scores = expected.score_row(model, row, rng);
+        for (size_t i = 0; i < actual.size(); ++i) {
+            DIST_ASSERT_CLOSE(actual[i], scores[i]);
+        }
+    }
+}
+
+void test_product_ingest_sequential() {
+    typedef ProductMixture<int, BetaBernoulli, NormalInverseChiSq> Product;
+
+    Product::Model model;
+    model.clustering.alpha = 2.0;
+    model.clustering.d = 0.1;
+    std::get<0>(model.features) = BetaBernoulli::Shared::EXAMPLE();
+    std::get<1>(model.features) = NormalInverseChiSq::Shared::EXAMPLE();
+
+    // one batch of tightly clustered rows, so that each row's assignment
+    // depends on the feature values of earlier rows in the same batch
+    rng_t rng;
+    const size_t batch_size = 40;
+    std::vector<Product::Row> rows(batch_size);
+    for (size_t i = 0; i < batch_size; ++i) {
+        rows[i] = Product::Row(i % 2, 4.f * (i % 2) + 0.01f * (i % 5));
+    }
+
+    for (bool map : {false, true}) {
+        rng_t streamed_rng(12345);
+        Product streamed;
+        streamed.init(model, streamed_rng);
+        std::vector<size_t> groupids(batch_size);
+        streamed.ingest_rows(
+            model,
+            batch_size,
+            rows.data(),
+            groupids.data(),
+            streamed_rng,
+            map);
+
+        // ingest_rows must match scoring and adding one row at a time
+        rng_t expected_rng(12345);
+        Product expected;
+        expected.init(model, expected_rng);
+        for (size_t i = 0; i < batch_size; ++i) {
+            VectorFloat & scores =
+                expected.score_row(model, rows[i], expected_rng);
+            size_t groupid;
+            if (map) {
+                groupid = std::max_element(scores.begin(), scores.end())
+                        - scores.begin();
+            } else {
+                groupid = sample_from_scores_overwrite(expected_rng, scores);
+            }
+            DIST_ASSERT_EQ(groupids[i], groupid);
+            expected.add_row(model, groupid, rows[i], expected_rng);
+        }
+        streamed.validate(model);
+        DIST_ASSERT_EQ(streamed.size(), expected.size());
+    }
+}
+
+int main() {
+#define DIST_TEST_MODEL(name) \
+    test_batched_updates<distributions::name>(); \
+    test_lazy_updates<distributions::name>(); \
+    test_tracked_score<distributions::name>(); \
+    test_score_value_range<distributions::name>(); \
+    test_score_data_grid<distributions::name>();
+    DIST_MODELS(DIST_TEST_MODEL);
+#undef DIST_TEST_MODEL
+    test_small_value_scores<distributions::BetaNegativeBinomial>();
+    test_small_value_scores<distributions::GammaPoisson>();
+    test_dd_score_data_grid();
+    test_niw_posterior_cache();
+    test_niw_score_data_grid();
+    test_niw_ground_truth();
+    test_id_tracker_churn();
+    test_parallel_sampler();
+    test_product_mixture();
+    test_product_ingest();
+    test_product_ingest_sequential();
+    return 0;
+}
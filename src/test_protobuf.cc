@@ -28,6 +28,7 @@
 #include <distributions/common.hpp>
 #include <distributions/assert_close.hpp>
 #include <distributions/io/protobuf.hpp>
+#include <distributions/clustering.hpp>
 
 #include <distributions/models/bb.hpp>
 #include <distributions/models/bnb.hpp>
@@ -108,9 +109,27 @@ void test_model() {
     DIST_ASSERT_CLOSE(group_message, group_message1);
 }
 
+template <typename count_t>
+void test_clustering() {
+    typedef distributions::Clustering<count_t> Clustering;
+    const count_t dataset_size = count_t(3) << 31;
+
+    typename Clustering::LowEntropy model;
+    model.dataset_size = dataset_size;
+
+    distributions::protobuf::Clustering::LowEntropy message;
+    model.protobuf_dump(message);
+
+    typename Clustering::LowEntropy model1;
+    model1.protobuf_load(message);
+    DIST_ASSERT_EQ(model1.dataset_size, dataset_size);
+}
+
 int main(void) {
 #define DIST_TEST_MODEL(name) test_model<distributions::name>();
     DIST_MODELS(DIST_TEST_MODEL);
 #undef DIST_TEST_MODEL
+    test_clustering<int64_t>();
+    test_clustering<uint64_t>();
     return 0;
 }
@@ -0,0 +1,160 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <vector>
+#include <distributions/common.hpp>
+#include <distributions/random.hpp>
+
+using namespace distributions;  // NOLINT(*)
+
+const size_t sample_count = 100000;
+
+// Checks sample mean and variance to within a few standard errors,
+// using the fourth central moment to bound the variance estimate.
+template<class Sampler>
+void assert_moments(
+        const Sampler & sampler,
+        double mean,
+        double variance,
+        double fourth_moment,
+        rng_t & rng) {
+    std::vector<int> values(sample_count);
+    sampler.fill(rng, values.size(), values.data());
+    double sum = 0;
+    for (int value : values) {
+        DIST_ASSERT_LE(0, value);
+        sum += value;
+    }
+    const double sample_mean = sum / values.size();
+    double sum_sq = 0;
+    for (int value : values) {
+        sum_sq += (value - sample_mean) * (value - sample_mean);
+    }
+    const double sample_variance = sum_sq / (values.size() - 1);
+
+    if (variance == 0) {
+        DIST_ASSERT_EQ(sample_mean, mean);
+        DIST_ASSERT_EQ(sample_variance, 0);
+        return;
+    }
+    const double stddevs = 5.0;
+    const double mean_error = std::sqrt(variance / values.size());
+    DIST_ASSERT(
+        std::fabs(sample_mean - mean) < stddevs * mean_error,
+        "expected mean " << mean << ", actual " << sample_mean);
+    const double variance_error = std::sqrt(
+        (fourth_moment - variance * variance) / values.size());
+    DIST_ASSERT(
+        std::fabs(sample_variance - variance) < stddevs * variance_error,
+        "expected variance " << variance << ", actual " << sample_variance);
+}
+
+void test_poisson_moments(rng_t & rng) {
+    const double switch_mean = PoissonSampler::ptrs_min_mean();
+    const std::vector<double> means = {
+        0.0, 0.01, 1.0, switch_mean - 0.01,
+        switch_mean, switch_mean + 0.01, 100.0, 1e6};
+    for (double mean : means) {
+        PoissonSampler sampler;
+        sampler.init(mean);
+        assert_moments(sampler, mean, mean, mean + 3 * mean * mean, rng);
+    }
+}
+
+// Compares the empirical pmf to the exact pmf in total variation, on
+// both sides of the switch from inversion to PTRS.
+void test_poisson_pmf(rng_t & rng) {
+    const double switch_mean = PoissonSampler::ptrs_min_mean();
+    for (double mean : {switch_mean - 0.01, switch_mean}) {
+        PoissonSampler sampler;
+        sampler.init(mean);
+        const int max_value = 60;
+        std::vector<double> counts(max_value + 1, 0);
+        for (size_t i = 0; i < sample_count; ++i) {
+            counts[std::min(sampler.eval(rng), max_value)] += 1;
+        }
+        double distance = 0;
+        for (int k = 0; k <= max_value; ++k) {
+            const double prob =
+                std::exp(k * std::log(mean) - mean - std::lgamma(k + 1));
+            distance += std::fabs(counts[k] / sample_count - prob);
+        }
+        DIST_ASSERT(
+            distance / 2 < 0.01,
+            "total variation " << distance / 2 << " at mean " << mean);
+    }
+}
+
+void test_negative_binomial_moments(rng_t & rng) {
+    struct Param { float p; int r; };
+    // means below, near and far above the Poisson switch
+    const std::vector<Param> params = {
+        {1.f, 5}, {0.5f, 0}, {0.9f, 1}, {0.5f, 10},
+        {0.1f, 2}, {0.01f, 10}, {1e-4f, 100}};
+    for (const auto & param : params) {
+        NegativeBinomialSampler sampler;
+        sampler.init(param.p, param.r);
+        const double p = param.p;
+        const double r = param.r;
+        const double mean = r * (1 - p) / p;
+        const double variance = mean / p;
+        const double excess_kurtosis = variance > 0
+            ? 6 / r + p * p / (r * (1 - p))
+            : 0;
+        const double fourth_moment =
+            variance * variance * (3 + excess_kurtosis);
+        assert_moments(sampler, mean, variance, fourth_moment, rng);
+    }
+}
+
+void test_sample_from_scores(rng_t & rng) {
+    const std::vector<float> scores = {-1.f, 0.f, -2.f, -0.5f};
+    std::vector<float> probs = scores;
+    scores_to_probs(probs);
+
+    std::vector<double> counts(scores.size(), 0);
+    for (size_t i = 0; i < sample_count; ++i) {
+        ++counts[sample_from_scores(rng, scores)];
+    }
+    DIST_ASSERT_EQ(scores[1], 0.f);
+    for (size_t i = 0; i < scores.size(); ++i) {
+        const double error = std::sqrt(probs[i] / sample_count);
+        DIST_ASSERT(
+            std::fabs(counts[i] / sample_count - probs[i]) < 5 * error,
+            "bad frequency of " << i);
+    }
+}
+
+int main() {
+    rng_t rng;
+    test_poisson_moments(rng);
+    test_poisson_pmf(rng);
+    test_negative_binomial_moments(rng);
+    test_sample_from_scores(rng);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <distributions/thread_pool.hpp>
+
+namespace distributions {
+
+namespace {
+
+// Spinning is cheap relative to a futex wakeup (~5-50us) but must not
+// starve the thread it waits for, hence the yielding fallback.
+const size_t PAUSE_SPIN_COUNT = 4096;
+const size_t YIELD_SPIN_COUNT = 64;
+
+inline void spin_pause(bool yields) {
+    if (yields) {
+        std::this_thread::yield();
+    } else {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+}   // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) :
+    workers_(),
+    run_mutex_(),
+    mutex_(),
+    started_(),
+    finished_(),
+    fun_(nullptr),
+    task_count_(0),
+    next_task_(0),
+    error_(),
+    busy_workers_(0),
+    generation_(0),
+    stopping_(false),
+    parked_workers_(0),
+    caller_parked_(false),
+    spin_count_(0),
+    spin_yields_(false) {
+    const size_t core_count =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (thread_count == 0) {
+        thread_count = core_count;
+    }
+    spin_yields_ = (thread_count > core_count);
+    spin_count_ = spin_yields_ ? YIELD_SPIN_COUNT : PAUSE_SPIN_COUNT;
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers_.push_back(std::thread(&ThreadPool::_work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stopping_ = true;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+    }
+    started_.notify_all();
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+// Parking follows the same protocol in both directions: the waiter
+// publishes that it is parked, then rechecks under the mutex; the waker
+// publishes its change, then notifies only if it sees a parked waiter.
+// Both sides use seq_cst so at least one of them sees the other.
+
+void ThreadPool::_run(
+        size_t task_count,
+        const std::function<void(size_t)> & fun) {
+    std::unique_lock<std::mutex> run_lock(run_mutex_);
+    fun_ = & fun;
+    task_count_ = task_count;
+    next_task_.store(0, std::memory_order_relaxed);
+    busy_workers_.store(workers_.size(), std::memory_order_relaxed);
+    ++generation_;
+    if (parked_workers_) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+        }
+        started_.notify_all();
+    }
+
+    _do_tasks();
+    _wait_for_workers();
+
+    fun_ = nullptr;
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::swap(error, error_);
+    }
+    if (DIST_UNLIKELY(error)) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::_wait_for_workers() {
+    for (size_t i = 0; i < spin_count_; ++i) {
+        if (busy_workers_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+        spin_pause(spin_yields_);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    caller_parked_ = true;
+    while (busy_workers_) {
+        finished_.wait(lock);
+    }
+    caller_parked_ = false;
+}
+
+void ThreadPool::_wait_for_batch(size_t generation) {
+    for (size_t i = 0; i < spin_count_; ++i) {
+        if (stopping_.load(std::memory_order_acquire) or
+            generation_.load(std::memory_order_acquire) != generation) {
+            return;
+        }
+        spin_pause(spin_yields_);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++parked_workers_;
+    while (not stopping_ and generation_ == generation) {
+        started_.wait(lock);
+    }
+    --parked_workers_;
+}
+
+void ThreadPool::_work() {
+    size_t generation = 0;
+    while (true) {
+        _wait_for_batch(generation);
+        if (stopping_) {
+            return;
+        }
+        generation = generation_;
+
+        _do_tasks();
+
+        if (--busy_workers_ == 0 and caller_parked_) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+            }
+            finished_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::_do_tasks() {
+    size_t task;
+    while ((task = next_task_++) < task_count_) {
+        try {
+            (*fun_)(task);
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (not error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+}
+
+}   // namespace distributions